@@ -0,0 +1,797 @@
+/* Benchmark driver for /dev/sort: sweeps sizes and input distributions,
+ * repeats every measurement and reports order statistics per method.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sort_types.h"
+#include "xoro_types.h"
+
+#define KSORT_DEV "/dev/sort"
+#define XORO_DEV "/dev/xoro"
+
+typedef enum {
+    DIST_RANDOM,
+    DIST_SORTED,
+    DIST_REVERSE,
+    DIST_NEARLY_SORTED,
+    DIST_FEW_UNIQUE,
+    DIST_SAWTOOTH,
+    DIST_ORGAN_PIPE,
+    DIST_ZIPF,
+    DIST_GAUSSIAN,
+    DIST_MAX
+} dist_t;
+
+static const char *dist_names[DIST_MAX] = {
+    "random",     "sorted",   "reverse",    "nearly-sorted",
+    "few-unique", "sawtooth", "organ-pipe", "zipf",
+    "gaussian",
+};
+
+static const char *method_names[] = {
+    [QSORT] = "qsort",
+    [TIMSORT] = "timsort",
+    [PDQSORT] = "pdqsort",
+    [LINUX_SORT] = "linuxsort",
+    [INPLACE_SORT] = "inplace",
+    [COUNT_SORT] = "count",
+};
+
+#define NR_METHODS (sizeof(method_names) / sizeof(method_names[0]))
+
+struct stats {
+    unsigned long long median, p99, min, max;
+    double mean, stddev;
+};
+
+typedef enum { SCALING_NONE, SCALING_STRONG, SCALING_WEAK } scaling_t;
+
+struct options {
+    bool methods[NR_METHODS];
+    dist_t dist;
+    size_t start, end, step;
+    bool geometric; /* step multiplies instead of adds */
+    unsigned warmup, reps;
+    uint64_t seed;
+    bool xoro; /* generate the input with /dev/xoro */
+    bool numa; /* sort in node-local chunks, see SORT_IOC_NUMA */
+    scaling_t scaling;
+    unsigned max_cpus; /* scaling sweeps 1 .. max_cpus */
+    const char *output;
+    bool json;
+};
+
+/* xoroshiro128+, the generator /dev/xoro exposes, seeded by splitmix64. */
+static uint64_t rng[2];
+
+static inline uint64_t rotl(const uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t next(void)
+{
+    const uint64_t s0 = rng[0];
+    uint64_t s1 = rng[1];
+    const uint64_t result = s0 + s1;
+
+    s1 ^= s0;
+    rng[0] = rotl(s0, 24) ^ s1 ^ (s1 << 16);
+    rng[1] = rotl(s1, 37);
+
+    return result;
+}
+
+static void seed(uint64_t x)
+{
+    for (int i = 0; i < 2; i++) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        rng[i] = z ^ (z >> 31);
+    }
+}
+
+/* Uniform double in [0, 1). */
+static double next_double(void)
+{
+    return (next() >> 11) * 0x1.0p-53;
+}
+
+static void generate(int *buf, size_t n, dist_t dist)
+{
+    size_t i;
+
+    switch (dist) {
+    case DIST_RANDOM:
+        for (i = 0; i < n; i++)
+            buf[i] = (int) (next() % n);
+        break;
+    case DIST_SORTED:
+        for (i = 0; i < n; i++)
+            buf[i] = (int) i;
+        break;
+    case DIST_REVERSE:
+        for (i = 0; i < n; i++)
+            buf[i] = (int) (n - i);
+        break;
+    case DIST_NEARLY_SORTED:
+        /* Sorted, then 1% of the positions swapped at random. */
+        for (i = 0; i < n; i++)
+            buf[i] = (int) i;
+        for (i = 0; i < n / 100; i++) {
+            size_t a = next() % n, b = next() % n;
+            int t = buf[a];
+            buf[a] = buf[b];
+            buf[b] = t;
+        }
+        break;
+    case DIST_FEW_UNIQUE:
+        for (i = 0; i < n; i++)
+            buf[i] = (int) (next() % 16);
+        break;
+    case DIST_SAWTOOTH: {
+        /* Sixteen ascending runs. */
+        size_t period = n / 16 ? n / 16 : 1;
+        for (i = 0; i < n; i++)
+            buf[i] = (int) (i % period);
+        break;
+    }
+    case DIST_ORGAN_PIPE:
+        for (i = 0; i < n; i++)
+            buf[i] = (int) (i < n / 2 ? i : n - i);
+        break;
+    case DIST_ZIPF: {
+        /* Continuous approximation of Zipf with s = 1 over [1, n]: the
+         * inverse CDF of a density proportional to 1/x.
+         */
+        double log_n = log((double) n + 1);
+        for (i = 0; i < n; i++)
+            buf[i] = (int) exp(next_double() * log_n);
+        break;
+    }
+    case DIST_GAUSSIAN:
+        /* Irwin-Hall, as /dev/xoro does: mean n / 2, deviation n / 6. */
+        for (i = 0; i < n; i++) {
+            double z = -6;
+            for (int j = 0; j < 12; j++)
+                z += next_double();
+            double v = (n - 1) / 2.0 + z * (n - 1) / 6.0;
+            buf[i] = (int) (v < 0 ? 0 : v > n - 1 ? n - 1 : v);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* The same distributions drawn by /dev/xoro, all but organ-pipe. */
+static bool generate_xoro(int fd, int *buf, size_t n, dist_t dist)
+{
+    size_t period = n / 16 ? n / 16 : 1;
+    struct xoro_fill req = {
+        .buf = (uintptr_t) buf,
+        .count = n,
+        .lo = 0,
+        .hi = n - 1,
+        .width = sizeof(int),
+    };
+
+    switch (dist) {
+    case DIST_RANDOM:
+        req.dist = XORO_DIST_UNIFORM;
+        break;
+    case DIST_SORTED:
+        req.dist = XORO_DIST_SORTED;
+        break;
+    case DIST_REVERSE:
+        req.dist = XORO_DIST_REVERSE;
+        req.lo = 1;
+        req.hi = n;
+        break;
+    case DIST_NEARLY_SORTED:
+        req.dist = XORO_DIST_NEARLY_SORTED;
+        req.param = n / 100;
+        break;
+    case DIST_FEW_UNIQUE:
+        req.dist = XORO_DIST_FEW_UNIQUE;
+        req.hi = 15;
+        req.param = 16;
+        break;
+    case DIST_SAWTOOTH:
+        req.dist = XORO_DIST_SORTED;
+        req.hi = period - 1;
+        req.param = period;
+        break;
+    case DIST_ZIPF:
+        req.dist = XORO_DIST_ZIPF;
+        req.lo = 1;
+        req.hi = n;
+        break;
+    case DIST_GAUSSIAN:
+        req.dist = XORO_DIST_GAUSSIAN;
+        break;
+    default:
+        return false;
+    }
+
+    return !ioctl(fd, XORO_IOC_FILL, &req);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *) a;
+    unsigned long long y = *(const unsigned long long *) b;
+    return (x > y) - (x < y);
+}
+
+static void compute_stats(unsigned long long *samples,
+                          unsigned n,
+                          struct stats *st)
+{
+    double sum = 0, var = 0;
+    unsigned i;
+
+    qsort(samples, n, sizeof(*samples), cmp_ull);
+    for (i = 0; i < n; i++)
+        sum += samples[i];
+    st->mean = sum / n;
+    for (i = 0; i < n; i++)
+        var += (samples[i] - st->mean) * (samples[i] - st->mean);
+    st->stddev = n > 1 ? sqrt(var / (n - 1)) : 0;
+
+    st->median = n % 2 ? samples[n / 2]
+                       : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    /* Nearest-rank percentile. */
+    st->p99 = samples[(unsigned) ceil(0.99 * n) - 1];
+    st->min = samples[0];
+    st->max = samples[n - 1];
+}
+
+static unsigned long long elapsed_ns(const struct timespec *start,
+                                     const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000ULL +
+           (end->tv_nsec - start->tv_nsec);
+}
+
+/* Sort one copy of input. Returns false if the kernel failed or the result
+ * is out of order.
+ */
+static bool run_once(int fd,
+                     const int *input,
+                     int *work,
+                     size_t n,
+                     unsigned long long *user_ns,
+                     unsigned long long *kernel_ns)
+{
+    struct timespec start, end;
+    ssize_t size = n * sizeof(int);
+
+    memcpy(work, input, size);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ssize_t r_sz = read(fd, work, size);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (r_sz != size)
+        return false;
+
+    *user_ns = elapsed_ns(&start, &end);
+    *kernel_ns = (unsigned long long) ioctl(fd, SORT_IOC_TIME, 0);
+
+    for (size_t i = 1; i < n; i++) {
+        if (work[i] < work[i - 1])
+            return false;
+    }
+    return true;
+}
+
+static void print_header(FILE *out, const struct options *opt)
+{
+    if (opt->json)
+        fprintf(out, "[\n");
+    else
+        fprintf(out,
+                "method,distribution,n,reps,user_median_ns,user_p99_ns,"
+                "user_stddev_ns,user_mean_ns,user_min_ns,kernel_median_ns,"
+                "kernel_p99_ns,kernel_stddev_ns\n");
+}
+
+static void print_result(FILE *out,
+                         const struct options *opt,
+                         sort_method_t method,
+                         size_t n,
+                         const struct stats *user,
+                         const struct stats *kernel,
+                         bool first)
+{
+    if (opt->json) {
+        fprintf(out,
+                "%s  {\"method\": \"%s\", \"distribution\": \"%s\", "
+                "\"n\": %zu, \"reps\": %u,\n"
+                "   \"user\": {\"median\": %llu, \"p99\": %llu, "
+                "\"stddev\": %.1f, \"mean\": %.1f, \"min\": %llu},\n"
+                "   \"kernel\": {\"median\": %llu, \"p99\": %llu, "
+                "\"stddev\": %.1f}}",
+                first ? "" : ",\n", method_names[method],
+                dist_names[opt->dist], n, opt->reps, user->median, user->p99,
+                user->stddev, user->mean, user->min, kernel->median,
+                kernel->p99, kernel->stddev);
+        return;
+    }
+
+    fprintf(out, "%s,%s,%zu,%u,%llu,%llu,%.1f,%.1f,%llu,%llu,%llu,%.1f\n",
+            method_names[method], dist_names[opt->dist], n, opt->reps,
+            user->median, user->p99, user->stddev, user->mean, user->min,
+            kernel->median, kernel->p99, kernel->stddev);
+}
+
+static void print_scaling_header(FILE *out, const struct options *opt)
+{
+    if (opt->json)
+        fprintf(out, "[\n");
+    else
+        fprintf(out,
+                "method,distribution,scaling,cpus,n,reps,kernel_median_ns,"
+                "user_median_ns,speedup,efficiency,work_items,busy_ns\n");
+}
+
+/* Speedup and efficiency are relative to the run on one CPU. Weak scaling
+ * grows n with the CPUs, so its speedup is the scaled one, cpus * T1 / Tp.
+ * Work items and the busy time of each CPU are per repetition.
+ */
+static void print_scaling_result(FILE *out,
+                                 const struct options *opt,
+                                 sort_method_t method,
+                                 unsigned cpus,
+                                 size_t n,
+                                 const struct stats *user,
+                                 const struct stats *kernel,
+                                 unsigned long long base_ns,
+                                 const struct sort_stats *sst,
+                                 bool first)
+{
+    double ratio = (double) base_ns / kernel->median;
+    double speedup = opt->scaling == SCALING_WEAK ? cpus * ratio : ratio;
+    double efficiency = speedup / cpus;
+    unsigned nr_cpus = sst->nr_cpus < opt->max_cpus ? sst->nr_cpus
+                                                    : opt->max_cpus;
+    const char *sep = opt->json ? ", " : ";";
+
+    if (opt->json)
+        fprintf(out,
+                "%s  {\"method\": \"%s\", \"distribution\": \"%s\", "
+                "\"scaling\": \"%s\", \"cpus\": %u, \"n\": %zu, "
+                "\"reps\": %u,\n"
+                "   \"kernel_median\": %llu, \"user_median\": %llu, "
+                "\"speedup\": %.3f, \"efficiency\": %.3f,\n"
+                "   \"work_items\": %.1f, \"busy_ns\": [",
+                first ? "" : ",\n", method_names[method],
+                dist_names[opt->dist],
+                opt->scaling == SCALING_WEAK ? "weak" : "strong", cpus, n,
+                opt->reps, kernel->median, user->median, speedup, efficiency,
+                (double) sst->work_items / opt->reps);
+    else
+        fprintf(out, "%s,%s,%s,%u,%zu,%u,%llu,%llu,%.3f,%.3f,%.1f,",
+                method_names[method], dist_names[opt->dist],
+                opt->scaling == SCALING_WEAK ? "weak" : "strong", cpus, n,
+                opt->reps, kernel->median, user->median, speedup, efficiency,
+                (double) sst->work_items / opt->reps);
+
+    for (unsigned c = 0; c < nr_cpus; c++)
+        fprintf(out, "%s%llu", c ? sep : "",
+                (unsigned long long) sst->busy_ns[c] / opt->reps);
+    fprintf(out, opt->json ? "]}" : "\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -m LIST   methods: qsort,timsort,pdqsort,linuxsort,inplace,\n"
+            "            count\n"
+            "            (default: all but pdqsort)\n"
+            "  -d DIST   random, sorted, reverse, nearly-sorted, few-unique,\n"
+            "            sawtooth, organ-pipe, zipf or gaussian "
+            "(default: random)\n"
+            "  -n RANGE  START[:END[:STEP]] sizes; STEP xF multiplies by F\n"
+            "            (default: 1000:20000:500)\n"
+            "  -w N      warm-up runs per point (default: 1)\n"
+            "  -r N      measured repetitions per point (default: 5)\n"
+            "  -s SEED   input seed (default: 1)\n"
+            "  -x        generate the input with /dev/xoro\n"
+            "  -N        sort in node-local chunks (SORT_IOC_NUMA)\n"
+            "  -S MODE   strong or weak scaling: sweep the CPUs allowed to\n"
+            "            sort from 1 to -c; n is START of -n, times the\n"
+            "            CPUs for weak scaling\n"
+            "  -c CPUS   most CPUs of the sweep (default: online CPUs)\n"
+            "  -o FILE   output file, JSON if it ends in .json "
+            "(default: bench.csv)\n",
+            prog);
+}
+
+static bool parse_methods(const char *arg, struct options *opt)
+{
+    char *list = strdup(arg), *save = NULL;
+    bool ok = true;
+
+    memset(opt->methods, 0, sizeof(opt->methods));
+    for (char *tok = strtok_r(list, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        size_t m;
+        for (m = 0; m < NR_METHODS; m++) {
+            if (!strcmp(tok, method_names[m]))
+                break;
+        }
+        if (m == NR_METHODS) {
+            fprintf(stderr, "Unknown method: %s\n", tok);
+            ok = false;
+            break;
+        }
+        opt->methods[m] = true;
+    }
+    free(list);
+    return ok;
+}
+
+static bool parse_range(const char *arg, struct options *opt)
+{
+    char *end;
+
+    opt->start = strtoull(arg, &end, 10);
+    opt->end = opt->start;
+    opt->step = 1;
+    opt->geometric = false;
+    if (*end == ':') {
+        opt->end = strtoull(end + 1, &end, 10);
+        if (*end == ':') {
+            end++;
+            if (*end == 'x') {
+                opt->geometric = true;
+                end++;
+            }
+            opt->step = strtoull(end, &end, 10);
+        }
+    }
+    return !*end && opt->start && opt->end >= opt->start && opt->step &&
+           !(opt->geometric && opt->step < 2);
+}
+
+static bool parse_options(int argc, char *argv[], struct options *opt)
+{
+    int c;
+
+    *opt = (struct options){
+        .methods = {[QSORT] = true,
+                    [TIMSORT] = true,
+                    [LINUX_SORT] = true,
+                    [INPLACE_SORT] = true,
+                    [COUNT_SORT] = true},
+        .dist = DIST_RANDOM,
+        .start = 1000,
+        .end = 20000,
+        .step = 500,
+        .warmup = 1,
+        .reps = 5,
+        .seed = 1,
+        .output = "bench.csv",
+    };
+
+    while ((c = getopt(argc, argv, "m:d:n:w:r:s:xNS:c:o:h")) != -1) {
+        switch (c) {
+        case 'm':
+            if (!parse_methods(optarg, opt))
+                return false;
+            break;
+        case 'd': {
+            int d;
+            for (d = 0; d < DIST_MAX; d++) {
+                if (!strcmp(optarg, dist_names[d]))
+                    break;
+            }
+            if (d == DIST_MAX) {
+                fprintf(stderr, "Unknown distribution: %s\n", optarg);
+                return false;
+            }
+            opt->dist = d;
+            break;
+        }
+        case 'n':
+            if (!parse_range(optarg, opt)) {
+                fprintf(stderr, "Invalid size range: %s\n", optarg);
+                return false;
+            }
+            break;
+        case 'w':
+            opt->warmup = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            opt->reps = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            opt->seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'x':
+            opt->xoro = true;
+            break;
+        case 'N':
+            opt->numa = true;
+            break;
+        case 'S':
+            if (!strcmp(optarg, "strong")) {
+                opt->scaling = SCALING_STRONG;
+            } else if (!strcmp(optarg, "weak")) {
+                opt->scaling = SCALING_WEAK;
+            } else {
+                fprintf(stderr, "Unknown scaling: %s\n", optarg);
+                return false;
+            }
+            break;
+        case 'c':
+            opt->max_cpus = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            opt->output = optarg;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    if (opt->xoro && opt->dist == DIST_ORGAN_PIPE) {
+        fprintf(stderr, "/dev/xoro cannot generate %s input\n",
+                dist_names[opt->dist]);
+        return false;
+    }
+
+    if (!opt->reps) {
+        fprintf(stderr, "At least one repetition is required\n");
+        return false;
+    }
+
+    if (!opt->max_cpus) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        opt->max_cpus = online > 0 ? online : 1;
+    }
+    /* The input buffer is sized by end. */
+    if (opt->scaling == SCALING_STRONG)
+        opt->end = opt->start;
+    else if (opt->scaling == SCALING_WEAK)
+        opt->end = opt->start * opt->max_cpus;
+
+    size_t len = strlen(opt->output);
+    opt->json = len >= 5 && !strcmp(opt->output + len - 5, ".json");
+    return true;
+}
+
+static bool make_input(int fdxoro,
+                       const struct options *opt,
+                       int *input,
+                       size_t n)
+{
+    if (opt->xoro) {
+        struct xoro_config cfg = {
+            .gen = XORO_128_PLUS,
+            .flags = XORO_SEED,
+            .seed = opt->seed,
+        };
+        if (ioctl(fdxoro, XORO_IOC_CONFIG, &cfg) ||
+            !generate_xoro(fdxoro, input, n, opt->dist)) {
+            perror("Failed to generate the input");
+            return false;
+        }
+    } else {
+        seed(opt->seed);
+        generate(input, n, opt->dist);
+    }
+    return true;
+}
+
+/* Warm up, then time opt->reps sorts of input. If sst is not NULL, it gets
+ * the module's stats of the timed sorts. Returns false if a sort failed.
+ */
+static bool measure(int fd,
+                    const struct options *opt,
+                    sort_method_t method,
+                    const int *input,
+                    int *work,
+                    size_t n,
+                    unsigned long long *user_ns,
+                    unsigned long long *kernel_ns,
+                    struct sort_stats *sst)
+{
+    unsigned failed = 0;
+
+    if (write(fd, &method, sizeof(method)) != sizeof(method)) {
+        perror("Failed to set sort method");
+        return false;
+    }
+
+    for (unsigned i = 0; i < opt->warmup + opt->reps; i++) {
+        unsigned long long u, k;
+
+        if (sst && i == opt->warmup && ioctl(fd, SORT_IOC_STATS, sst)) {
+            perror("Failed to read sort stats");
+            return false;
+        }
+        if (!run_once(fd, input, work, n, &u, &k)) {
+            failed++;
+            continue;
+        }
+        if (i >= opt->warmup) {
+            user_ns[i - opt->warmup] = u;
+            kernel_ns[i - opt->warmup] = k;
+        }
+    }
+    if (sst && ioctl(fd, SORT_IOC_STATS, sst)) {
+        perror("Failed to read sort stats");
+        return false;
+    }
+
+    if (failed) {
+        fprintf(stderr, "%s on %zu %s elements failed %u time(s)\n",
+                method_names[method], n, dist_names[opt->dist], failed);
+        return false;
+    }
+    return true;
+}
+
+static bool run_scaling(int fd,
+                        int fdxoro,
+                        const struct options *opt,
+                        FILE *out,
+                        int *input,
+                        int *work,
+                        unsigned long long *user_ns,
+                        unsigned long long *kernel_ns)
+{
+    struct sort_stats *sst = malloc(sizeof(*sst));
+    bool first = true, ok = false;
+
+    if (!sst) {
+        perror("Failed to set up benchmark");
+        return false;
+    }
+
+    print_scaling_header(out, opt);
+
+    for (size_t m = 0; m < NR_METHODS; m++) {
+        unsigned long long base_ns = 0;
+
+        if (!opt->methods[m])
+            continue;
+
+        for (unsigned cpus = 1; cpus <= opt->max_cpus; cpus++) {
+            size_t n = opt->scaling == SCALING_WEAK ? opt->start * cpus
+                                                    : opt->start;
+            struct stats user, kernel;
+
+            if (ioctl(fd, SORT_IOC_CPUS, cpus)) {
+                perror("Failed to limit the sort CPUs");
+                goto out;
+            }
+            if (!make_input(fdxoro, opt, input, n) ||
+                !measure(fd, opt, m, input, work, n, user_ns, kernel_ns,
+                         sst))
+                goto out;
+
+            compute_stats(user_ns, opt->reps, &user);
+            compute_stats(kernel_ns, opt->reps, &kernel);
+            if (cpus == 1)
+                base_ns = kernel.median;
+            print_scaling_result(out, opt, m, cpus, n, &user, &kernel,
+                                 base_ns, sst, first);
+            first = false;
+
+            fprintf(stderr, "%-10s cpus=%-4u n=%-10zu median %llu ns\n",
+                    method_names[m], cpus, n, kernel.median);
+        }
+    }
+
+    if (opt->json)
+        fprintf(out, "\n]\n");
+    ok = true;
+
+out:
+    ioctl(fd, SORT_IOC_CPUS, 0);
+    free(sst);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    struct options opt;
+    unsigned long long *user_ns, *kernel_ns;
+    int *input = NULL, *work = NULL;
+    bool first = true;
+    int ret = 1;
+
+    if (!parse_options(argc, argv, &opt)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(KSORT_DEV, O_RDWR);
+    int fdxoro = opt.xoro ? open(XORO_DEV, O_RDONLY) : -1;
+    if (fd < 0 || (opt.xoro && fdxoro < 0)) {
+        perror("Failed to open character device");
+        return 1;
+    }
+
+    if (opt.numa && ioctl(fd, SORT_IOC_NUMA, 1)) {
+        perror("Failed to select NUMA mode");
+        return 1;
+    }
+
+    FILE *out = fopen(opt.output, "w");
+    user_ns = calloc(opt.reps, sizeof(*user_ns));
+    kernel_ns = calloc(opt.reps, sizeof(*kernel_ns));
+    input = malloc(opt.end * sizeof(int));
+    work = malloc(opt.end * sizeof(int));
+    if (!out || !user_ns || !kernel_ns || !input || !work) {
+        perror("Failed to set up benchmark");
+        goto out;
+    }
+
+    if (opt.scaling != SCALING_NONE) {
+        if (run_scaling(fd, fdxoro, &opt, out, input, work, user_ns,
+                        kernel_ns))
+            ret = 0;
+        goto out;
+    }
+
+    print_header(out, &opt);
+
+    for (size_t n = opt.start; n <= opt.end;
+         n = opt.geometric ? n * opt.step : n + opt.step) {
+        if (!make_input(fdxoro, &opt, input, n))
+            goto out;
+
+        for (size_t m = 0; m < NR_METHODS; m++) {
+            struct stats user, kernel;
+
+            if (!opt.methods[m])
+                continue;
+            if (!measure(fd, &opt, m, input, work, n, user_ns, kernel_ns,
+                         NULL))
+                continue;
+
+            compute_stats(user_ns, opt.reps, &user);
+            compute_stats(kernel_ns, opt.reps, &kernel);
+            print_result(out, &opt, m, n, &user, &kernel, first);
+            first = false;
+
+            fprintf(stderr, "%-10s %-13s n=%-10zu median %llu ns\n",
+                    method_names[m], dist_names[opt.dist], n, user.median);
+        }
+    }
+
+    if (opt.json)
+        fprintf(out, "\n]\n");
+    ret = 0;
+
+out:
+    free(input);
+    free(work);
+    free(user_ns);
+    free(kernel_ns);
+    if (out)
+        fclose(out);
+    if (fdxoro >= 0)
+        close(fdxoro);
+    close(fd);
+    return ret;
+}
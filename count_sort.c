@@ -0,0 +1,213 @@
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/time.h>
+#include <linux/workqueue.h>
+
+#include "count_sort.h"
+#include "sort.h"
+#include "sort_stats.h"
+
+/* Fewer elements sort by comparison before the rounds below get going. */
+#define COUNT_MIN_N 4096
+
+/* Elements, or keys, a worker gets at the least. */
+#define COUNT_MIN_PART 65536
+
+/* The histograms of all workers together may take this many times the
+ * bytes of the array. A narrower range leaves room for one per CPU.
+ */
+#define COUNT_HIST_FACTOR 4
+
+struct count_sort {
+    int *a;
+    int min;
+    size_t range;  /* max - min + 1 */
+    u32 *hist;     /* nr_hist histograms of range counters, back to back */
+    size_t nr_hist;
+};
+
+/* One worker's share of a round: elements [lo, hi) of a while finding the
+ * range and counting, keys min + [lo, hi) while summing and writing back.
+ */
+struct count_part {
+    struct work_struct w;
+    struct count_sort *cs;
+    size_t lo, hi;
+    int min, max;  /* of its elements, after the first round */
+    u32 *hist;     /* its own histogram while counting */
+    size_t pos;    /* number of its keys, then where they start in a */
+};
+
+static void count_minmax_func(struct work_struct *w)
+{
+    struct count_part *p = container_of(w, struct count_part, w);
+    const int *a = p->cs->a;
+    ktime_t start = ktime_get();
+    unsigned int work = 0;
+    int min = a[p->lo], max = a[p->lo];
+    size_t i;
+
+    for (i = p->lo + 1; i < p->hi; i++) {
+        sort_resched(&work);
+        if (a[i] < min)
+            min = a[i];
+        else if (a[i] > max)
+            max = a[i];
+    }
+    p->min = min;
+    p->max = max;
+    sort_stats_account(start);
+}
+
+/* Every part counts into a histogram of its own, so no two CPUs write the
+ * same counters. Keys are offsets from min, which unsigned arithmetic gets
+ * right even when max - min does not fit an int.
+ */
+static void count_hist_func(struct work_struct *w)
+{
+    struct count_part *p = container_of(w, struct count_part, w);
+    struct count_sort *cs = p->cs;
+    ktime_t start = ktime_get();
+    unsigned int work = 0;
+    size_t i;
+
+    memset(p->hist, 0, cs->range * sizeof(*p->hist));
+    for (i = p->lo; i < p->hi; i++) {
+        sort_resched(&work);
+        p->hist[(u32) cs->a[i] - (u32) cs->min]++;
+    }
+    sort_stats_account(start);
+}
+
+/* Sum the counts of keys [lo, hi) into the first histogram. */
+static void count_reduce_func(struct work_struct *w)
+{
+    struct count_part *p = container_of(w, struct count_part, w);
+    struct count_sort *cs = p->cs;
+    ktime_t start = ktime_get();
+    unsigned int work = 0;
+    size_t k, h;
+
+    p->pos = 0;
+    for (k = p->lo; k < p->hi; k++) {
+        u32 count = cs->hist[k];
+
+        sort_resched(&work);
+        for (h = 1; h < cs->nr_hist; h++)
+            count += cs->hist[h * cs->range + k];
+        cs->hist[k] = count;
+        p->pos += count;
+    }
+    sort_stats_account(start);
+}
+
+static void count_fill_func(struct work_struct *w)
+{
+    struct count_part *p = container_of(w, struct count_part, w);
+    struct count_sort *cs = p->cs;
+    int *out = cs->a + p->pos;
+    ktime_t start = ktime_get();
+    unsigned int work = 0;
+    size_t k;
+
+    for (k = p->lo; k < p->hi; k++) {
+        int key = (s64) cs->min + k;
+        u32 count = cs->hist[k];
+
+        while (count--) {
+            sort_resched(&work);
+            *out++ = key;
+        }
+    }
+    sort_stats_account(start);
+}
+
+/* Split total elements or keys evenly over nr parts. */
+static void count_split(struct count_part *parts, size_t nr, size_t total)
+{
+    size_t i;
+
+    for (i = 0; i < nr; i++) {
+        parts[i].lo = total * i / nr;
+        parts[i].hi = total * (i + 1) / nr;
+    }
+}
+
+/* Run fn on the first nr parts, one CPU each, and wait for all of them. */
+static void count_round(struct count_part *parts, size_t nr, work_func_t fn)
+{
+    int cpu = -1;
+    size_t i;
+
+    for (i = 0; i < nr; i++) {
+        INIT_WORK(&parts[i].w, fn);
+        cpu = next_online_cpu(cpu);
+        queue_work_on(cpu, workqueue, &parts[i].w);
+    }
+    for (i = 0; i < nr; i++)
+        flush_work(&parts[i].w);
+}
+
+int count_sort(int *a, size_t n)
+{
+    struct count_sort cs = {.a = a};
+    struct count_part *parts;
+    size_t nr, nr_keys, i, pos = 0;
+    int max_key;
+    int ret = -ERANGE;
+
+    /* The counters are u32. */
+    if (n < COUNT_MIN_N || n > U32_MAX)
+        return -ERANGE;
+
+    nr = clamp_t(size_t, n / COUNT_MIN_PART, 1, nr_sort_cpus());
+    parts = kcalloc(nr, sizeof(*parts), GFP_KERNEL);
+    if (!parts)
+        return -ENOMEM;
+    for (i = 0; i < nr; i++)
+        parts[i].cs = &cs;
+
+    count_split(parts, nr, n);
+    count_round(parts, nr, count_minmax_func);
+    cs.min = parts[0].min;
+    max_key = parts[0].max;
+    for (i = 1; i < nr; i++) {
+        cs.min = min(cs.min, parts[i].min);
+        max_key = max(max_key, parts[i].max);
+    }
+    cs.range = (s64) max_key - cs.min + 1;
+    if (cs.range > n)
+        goto out;
+
+    /* Every further histogram costs a pass over range counters to zero and
+     * to sum, so only as many as the data pays for.
+     */
+    cs.nr_hist = clamp_t(size_t, COUNT_HIST_FACTOR * n / cs.range, 1, nr);
+    cs.hist = kvmalloc_array(cs.nr_hist * cs.range, sizeof(*cs.hist),
+                             GFP_KERNEL);
+    if (!cs.hist) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    count_split(parts, cs.nr_hist, n);
+    for (i = 0; i < cs.nr_hist; i++)
+        parts[i].hist = cs.hist + i * cs.range;
+    count_round(parts, cs.nr_hist, count_hist_func);
+
+    nr_keys = clamp_t(size_t, cs.range / COUNT_MIN_PART, 1, nr);
+    count_split(parts, nr_keys, cs.range);
+    count_round(parts, nr_keys, count_reduce_func);
+    for (i = 0; i < nr_keys; i++) {
+        size_t len = parts[i].pos;
+
+        parts[i].pos = pos;
+        pos += len;
+    }
+    count_round(parts, nr_keys, count_fill_func);
+    ret = 0;
+
+out:
+    kvfree(cs.hist);
+    kfree(parts);
+    return ret;
+}
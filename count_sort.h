@@ -0,0 +1,15 @@
+#ifndef COUNT_SORT_H
+#define COUNT_SORT_H
+
+#include <linux/types.h>
+
+/* Sort the n ints at a by counting, if their keys span no more values than
+ * there are elements. One parallel pass finds the range, a second counts
+ * the keys into a histogram per worker, and the histograms are summed and
+ * written back as runs of equal keys, all in O(n + range). Returns 0,
+ * -ERANGE when the keys are too far apart or n too small to gain anything,
+ * or -ENOMEM; a is untouched unless 0 is returned. Sleeps.
+ */
+int count_sort(int *a, size_t n);
+
+#endif  // COUNT_SORT_H
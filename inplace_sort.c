@@ -0,0 +1,347 @@
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/slab.h>
+#include <linux/time.h>
+#include <linux/workqueue.h>
+
+#include "inplace_sort.h"
+#include "sort_stats.h"
+
+/* Chunks shorter than this are not worth a CPU of their own. */
+#define INPLACE_MIN_PART 8192
+
+/* Merges at least this long hand one half to another work item. */
+#define INPLACE_MIN_MERGE 4096
+
+/* Length of the runs insertion sort builds before the first merges. */
+#define INPLACE_BLOCK 20
+
+/* How elements are swapped: a word, an int or a byte at a time. */
+enum { SWAP_LONG, SWAP_INT, SWAP_BYTE };
+
+struct inplace {
+    char *base;
+    size_t es;
+    cmp_t *cmp;
+    const void *priv;
+    int swaptype;
+    int cpu; /* Last CPU a work item was queued on */
+
+    /* Work items of the current round, plus one held by the caller. */
+    atomic_t pending;
+    struct completion done;
+};
+
+/* Sort the chunk [a, b), or merge its sorted runs [a, m) and [m, b). */
+struct inplace_work {
+    struct work_struct w;
+    struct inplace *s;
+    bool chunk;
+    size_t a, m, b;
+};
+
+#define AT(s, i) ((s)->base + (i) * (s)->es)
+
+static inline bool less(struct inplace *s,
+                        size_t i,
+                        size_t j,
+                        unsigned int *work)
+{
+    sort_resched(work);
+    return s->cmp(AT(s, i), AT(s, j), s->priv) < 0;
+}
+
+/* Swap the n elements from i with the n elements from j. */
+static void swap_range(struct inplace *s,
+                       size_t i,
+                       size_t j,
+                       size_t n,
+                       unsigned int *work)
+{
+    char *x = AT(s, i), *y = AT(s, j);
+    char *end = x + n * s->es;
+    size_t k;
+
+    for (; x < end; x += s->es, y += s->es) {
+        sort_resched(work);
+        switch (s->swaptype) {
+        case SWAP_LONG:
+            for (k = 0; k < s->es; k += sizeof(long))
+                swap(*(long *) (x + k), *(long *) (y + k));
+            break;
+        case SWAP_INT:
+            for (k = 0; k < s->es; k += sizeof(int))
+                swap(*(int *) (x + k), *(int *) (y + k));
+            break;
+        default:
+            for (k = 0; k < s->es; k++)
+                swap(x[k], y[k]);
+        }
+    }
+}
+
+/* Turn [a, m) [m, b) into [m, b) [a, m), swapping the shorter side into
+ * place until both sides are the same length.
+ */
+static void rotate(struct inplace *s,
+                   size_t a,
+                   size_t m,
+                   size_t b,
+                   unsigned int *work)
+{
+    size_t i = m - a, j = b - m;
+
+    if (!i || !j)
+        return;
+
+    while (i != j) {
+        if (i > j) {
+            swap_range(s, m - i, m, j, work);
+            i -= j;
+        } else {
+            swap_range(s, m - i, m + j - i, i, work);
+            j -= i;
+        }
+    }
+    swap_range(s, m - i, m, i, work);
+}
+
+static void insertion_sort(struct inplace *s,
+                           size_t a,
+                           size_t b,
+                           unsigned int *work)
+{
+    size_t i, j;
+
+    for (i = a + 1; i < b; i++)
+        for (j = i; j > a && less(s, j, j - 1, work); j--)
+            swap_range(s, j, j - 1, 1, work);
+}
+
+static void inplace_queue(struct inplace *s,
+                          bool chunk,
+                          size_t a,
+                          size_t m,
+                          size_t b);
+
+/* Merge the sorted runs [a, m) and [m, b) in place, after Kim and Kutzner,
+ * "Stable Minimum Storage Merging by Symmetric Comparisons". Elements of
+ * [a, m) go first among equal ones. The rotation leaves two independent
+ * merges; with fan_out, a long second one goes to another work item.
+ */
+static void sym_merge(struct inplace *s,
+                      size_t a,
+                      size_t m,
+                      size_t b,
+                      bool fan_out,
+                      unsigned int *work)
+{
+    size_t mid, n, lo, hi, end;
+
+    if (m - a == 1) {
+        /* Move the one element before the first of [m, b) not less. */
+        lo = m;
+        hi = b;
+        while (lo < hi) {
+            size_t h = lo + (hi - lo) / 2;
+
+            if (less(s, h, a, work))
+                lo = h + 1;
+            else
+                hi = h;
+        }
+        rotate(s, a, m, lo, work);
+        return;
+    }
+    if (b - m == 1) {
+        /* Move the one element before the first of [a, m) greater. */
+        lo = a;
+        hi = m;
+        while (lo < hi) {
+            size_t h = lo + (hi - lo) / 2;
+
+            if (!less(s, m, h, work))
+                lo = h + 1;
+            else
+                hi = h;
+        }
+        rotate(s, lo, m, b, work);
+        return;
+    }
+
+    mid = a + (b - a) / 2;
+    n = mid + m;
+    if (m > mid) {
+        lo = n - b;
+        hi = mid;
+    } else {
+        lo = a;
+        hi = m;
+    }
+    while (lo < hi) {
+        size_t c = lo + (hi - lo) / 2;
+
+        if (!less(s, n - 1 - c, c, work))
+            lo = c + 1;
+        else
+            hi = c;
+    }
+    end = n - lo;
+
+    if (lo < m && m < end)
+        rotate(s, lo, m, end, work);
+    if (mid < end && end < b) {
+        if (fan_out && b - mid >= INPLACE_MIN_MERGE)
+            inplace_queue(s, false, mid, end, b);
+        else
+            sym_merge(s, mid, end, b, fan_out, work);
+    }
+    if (a < lo && lo < mid)
+        sym_merge(s, a, lo, mid, fan_out, work);
+}
+
+/* Bottom-up merge sort of [a, b) on the calling CPU. */
+static void sort_chunk(struct inplace *s,
+                       size_t a,
+                       size_t b,
+                       unsigned int *work)
+{
+    size_t i, width;
+
+    for (i = a; i < b; i += INPLACE_BLOCK)
+        insertion_sort(s, i, min(i + INPLACE_BLOCK, b), work);
+
+    for (width = INPLACE_BLOCK; width < b - a; width *= 2) {
+        for (i = a; i + width < b; i += 2 * width) {
+            size_t m = i + width;
+
+            if (less(s, m, m - 1, work))
+                sym_merge(s, i, m, min(m + width, b), false, work);
+        }
+    }
+}
+
+static void inplace_run(struct inplace *s,
+                        bool chunk,
+                        size_t a,
+                        size_t m,
+                        size_t b)
+{
+    unsigned int work = 0;
+
+    if (chunk)
+        sort_chunk(s, a, b, &work);
+    else
+        sym_merge(s, a, m, b, true, &work);
+}
+
+/* The completion is the last thing touched, as the waiter owns s. */
+static void inplace_put(struct inplace *s)
+{
+    if (atomic_dec_and_test(&s->pending))
+        complete(&s->done);
+}
+
+/* Every struct inplace_work is queued once and freed by its own work
+ * function.
+ */
+static void inplace_func(struct work_struct *w)
+{
+    struct inplace_work *iw = container_of(w, struct inplace_work, w);
+    struct inplace *s = iw->s;
+    ktime_t start = ktime_get();
+
+    inplace_run(s, iw->chunk, iw->a, iw->m, iw->b);
+    kfree(iw);
+    sort_stats_account(start);
+    inplace_put(s);
+}
+
+/* Run on another CPU, or right here if out of memory. Workers racing on
+ * s->cpu may pick the same CPU, which only costs balance.
+ */
+static void inplace_queue(struct inplace *s,
+                          bool chunk,
+                          size_t a,
+                          size_t m,
+                          size_t b)
+{
+    struct inplace_work *iw = kmalloc(sizeof(*iw), GFP_KERNEL);
+    int cpu;
+
+    if (!iw) {
+        inplace_run(s, chunk, a, m, b);
+        return;
+    }
+    INIT_WORK(&iw->w, inplace_func);
+    iw->s = s;
+    iw->chunk = chunk;
+    iw->a = a;
+    iw->m = m;
+    iw->b = b;
+
+    atomic_inc(&s->pending);
+    cpu = next_online_cpu(READ_ONCE(s->cpu));
+    WRITE_ONCE(s->cpu, cpu);
+    queue_work_on(cpu, workqueue, &iw->w);
+}
+
+/* Drop the caller's reference to the round and wait for its work items. */
+static void inplace_wait(struct inplace *s)
+{
+    inplace_put(s);
+    wait_for_completion(&s->done);
+    atomic_set(&s->pending, 1);
+}
+
+void inplace_sort(void *base,
+                  size_t n,
+                  size_t es,
+                  cmp_t *cmp,
+                  const void *priv)
+{
+    struct inplace s = {
+        .base = base,
+        .es = es,
+        .cmp = cmp,
+        .priv = priv,
+        .cpu = -1,
+    };
+    size_t nr_parts = clamp_t(size_t, n / INPLACE_MIN_PART, 1, nr_sort_cpus());
+    size_t p, width;
+    unsigned long align = (char *) base - (char *) 0;
+
+    if (n <= 1)
+        return;
+
+    if (!(align % sizeof(long)) && !(es % sizeof(long)))
+        s.swaptype = SWAP_LONG;
+    else if (!(align % sizeof(int)) && !(es % sizeof(int)))
+        s.swaptype = SWAP_INT;
+    else
+        s.swaptype = SWAP_BYTE;
+
+    atomic_set(&s.pending, 1);
+    init_completion(&s.done);
+
+    /* Chunk p covers [p * n / nr_parts, (p + 1) * n / nr_parts). */
+    for (p = 0; p < nr_parts; p++)
+        inplace_queue(&s, true, p * n / nr_parts, 0, (p + 1) * n / nr_parts);
+    inplace_wait(&s);
+
+    /* Every round halves the number of runs; it needs the previous one to
+     * have finished, while the merges within a round are independent.
+     */
+    for (width = 1; width < nr_parts; width *= 2) {
+        for (p = 0; p + width < nr_parts; p += 2 * width) {
+            size_t a = p * n / nr_parts;
+            size_t m = (p + width) * n / nr_parts;
+            size_t b = min(p + 2 * width, nr_parts) * n / nr_parts;
+            unsigned int work = 0;
+
+            if (less(&s, m, m - 1, &work))
+                inplace_queue(&s, false, a, m, b);
+        }
+        inplace_wait(&s);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef INPLACE_SORT_H
+#define INPLACE_SORT_H
+
+#include <linux/types.h>
+
+#include "sort.h"
+
+/* Sort the n elements of es bytes at base stably, without a buffer for the
+ * elements: runs are merged in place by binary search and block rotations
+ * (SymMerge), at the cost of O(n log^2 n) element moves. One chunk per CPU
+ * is sorted on the workqueue, then rounds of merges pair up neighbouring
+ * chunks, with large merges fanning out over the CPUs. Sleeps.
+ */
+void inplace_sort(void *base,
+                  size_t n,
+                  size_t es,
+                  cmp_t *cmp,
+                  const void *priv);
+
+#endif  // INPLACE_SORT_H
@@ -0,0 +1,26 @@
+#ifndef KSORT_ARRAY_H
+#define KSORT_ARRAY_H
+
+#include <linux/completion.h>
+#include <linux/sort.h>
+
+/* ksort_array() flags */
+#define KSORT_SYNC 0  /* return once the array is sorted */
+#define KSORT_ASYNC 1 /* return at once, complete done once it is sorted */
+
+/* Sort num elements of size bytes at base, with the contract of sort() in
+ * lib/sort.c: cmp_func orders them and swap_func, if not NULL, swaps two of
+ * them. The work is spread over the module's workqueue with the qsort
+ * engine, so the sort is not stable. With KSORT_ASYNC, base must stay
+ * valid until done completes. Returns 0, -EINVAL for bad flags or size, or
+ * -ENOMEM if the asynchronous request cannot be allocated. Sleeps.
+ */
+int ksort_array(void *base,
+                size_t num,
+                size_t size,
+                cmp_func_t cmp_func,
+                swap_func_t swap_func,
+                unsigned int flags,
+                struct completion *done);
+
+#endif  // KSORT_ARRAY_H
@@ -0,0 +1,174 @@
+#include <linux/export.h>
+#include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/time.h>
+#include <linux/workqueue.h>
+
+#include "ksort_list.h"
+#include "sort.h"
+#include "sort_stats.h"
+
+/* Lists shorter than this per CPU are left to a single list_sort(). */
+#define LIST_MIN_CHUNK 16384
+
+/* Number of samples per range used to choose the splitters. */
+#define LIST_OVERSAMPLE 16
+
+struct list_split;
+
+/* A chunk of consecutive nodes while the list is partitioned, then the
+ * nodes of one key range while they are sorted.
+ */
+struct list_chunk {
+    struct work_struct w;
+    struct list_split *s;
+    struct list_head list;
+    struct list_head *ranges; /* this chunk's nodes of every range */
+};
+
+struct list_split {
+    void *priv;
+    list_cmp_func_t cmp;
+    size_t nr; /* chunks, and key ranges */
+    struct list_head **splitters;
+    struct list_chunk *chunks;
+};
+
+static int sample_cmp(const void *a, const void *b, const void *priv)
+{
+    const struct list_split *s = priv;
+
+    return s->cmp(s->priv, *(struct list_head *const *) a,
+                  *(struct list_head *const *) b);
+}
+
+/* Index of the range node belongs to: the number of splitters not greater
+ * than node, so equal nodes never straddle two ranges.
+ */
+static size_t list_classify(const struct list_split *s,
+                            const struct list_head *node)
+{
+    size_t lo = 0, hi = s->nr - 1;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+
+        if (s->cmp(s->priv, s->splitters[mid], node) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void list_partition_func(struct work_struct *w)
+{
+    struct list_chunk *c = container_of(w, struct list_chunk, w);
+    struct list_head *node, *safe;
+    ktime_t start = ktime_get();
+    unsigned int work = 0;
+
+    list_for_each_safe (node, safe, &c->list) {
+        sort_resched(&work);
+        list_move_tail(node, &c->ranges[list_classify(c->s, node)]);
+    }
+    sort_stats_account(start);
+}
+
+/* Gather range i from every chunk, in chunk order, and sort it. */
+static void list_sort_func(struct work_struct *w)
+{
+    struct list_chunk *c = container_of(w, struct list_chunk, w);
+    const struct list_split *s = c->s;
+    size_t i = c - s->chunks, j;
+    ktime_t start = ktime_get();
+
+    for (j = 0; j < s->nr; j++)
+        list_splice_tail_init(&s->chunks[j].ranges[i], &c->list);
+    list_sort(s->priv, &c->list, s->cmp);
+    sort_stats_account(start);
+}
+
+/* Run func on every chunk, one CPU each, and wait for all of them. */
+static void list_run(struct list_split *s, work_func_t func)
+{
+    size_t i;
+    int cpu = -1;
+
+    for (i = 0; i < s->nr; i++) {
+        INIT_WORK(&s->chunks[i].w, func);
+        cpu = next_online_cpu(cpu);
+        queue_work_on(cpu, workqueue, &s->chunks[i].w);
+    }
+    for (i = 0; i < s->nr; i++)
+        flush_work(&s->chunks[i].w);
+}
+
+void ksort_list(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+    struct list_split s = {.priv = priv, .cmp = cmp};
+    struct list_head *node, *ranges = NULL, **samples = NULL;
+    size_t n = 0, nr_samples, stride, pos, i, j, r;
+    unsigned int work = 0;
+
+    list_for_each (node, head) {
+        sort_resched(&work);
+        n++;
+    }
+
+    s.nr = clamp_t(size_t, n / LIST_MIN_CHUNK, 1, nr_sort_cpus());
+    if (s.nr == 1)
+        goto serial;
+
+    nr_samples = s.nr * LIST_OVERSAMPLE;
+    stride = n / nr_samples;
+    s.chunks = kvmalloc_array(s.nr, sizeof(*s.chunks), GFP_KERNEL);
+    ranges = kvmalloc_array(s.nr * s.nr, sizeof(*ranges), GFP_KERNEL);
+    samples = kvmalloc_array(nr_samples, sizeof(*samples), GFP_KERNEL);
+    if (!s.chunks || !ranges || !samples)
+        goto serial;
+
+    /* Cut the list into chunks of consecutive nodes, sampling every
+     * stride-th node on the way.
+     */
+    for (i = 0, j = 0, pos = 0; i < s.nr; i++) {
+        struct list_chunk *c = &s.chunks[i];
+        size_t end = n * (i + 1) / s.nr;
+
+        for (node = head; pos < end; pos++) {
+            sort_resched(&work);
+            node = node->next;
+            if (pos % stride == stride / 2 && j < nr_samples)
+                samples[j++] = node;
+        }
+        list_cut_position(&c->list, head, node);
+        c->s = &s;
+        c->ranges = ranges + i * s.nr;
+        for (r = 0; r < s.nr; r++)
+            INIT_LIST_HEAD(&c->ranges[r]);
+    }
+
+    sort_r(samples, nr_samples, sizeof(*samples), sample_cmp, NULL, &s);
+    for (i = 1; i < s.nr; i++)
+        samples[i - 1] = samples[i * LIST_OVERSAMPLE];
+    s.splitters = samples;
+
+    list_run(&s, list_partition_func);
+    list_run(&s, list_sort_func);
+
+    for (i = 0; i < s.nr; i++)
+        list_splice_tail(&s.chunks[i].list, head);
+
+    kvfree(samples);
+    kvfree(ranges);
+    kvfree(s.chunks);
+    return;
+
+serial:
+    kvfree(samples);
+    kvfree(ranges);
+    kvfree(s.chunks);
+    list_sort(priv, head, cmp);
+}
+EXPORT_SYMBOL(ksort_list);
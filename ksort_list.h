@@ -0,0 +1,15 @@
+#ifndef KSORT_LIST_H
+#define KSORT_LIST_H
+
+#include <linux/list_sort.h>
+
+/* Drop-in for list_sort(): sorts the list at head stably, in the order cmp
+ * defines, on the CPUs the module may use. Long lists are partitioned by
+ * key ranges chosen from a sample, and every range is sorted with
+ * list_sort() on its own CPU. cmp must not look at the list links, which
+ * other CPUs rewrite meanwhile. Short lists, or a failed allocation, fall
+ * back to a single list_sort(). Sleeps.
+ */
+void ksort_list(void *priv, struct list_head *head, list_cmp_func_t cmp);
+
+#endif  // KSORT_LIST_H
@@ -0,0 +1,301 @@
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+
+#include "kway_merge.h"
+#include "sort_stats.h"
+
+/* Parts smaller than this are merged without splitting the key range. */
+#define KWAY_MIN_PART 4096
+
+/* Number of samples per part used to choose the splitter keys. */
+#define KWAY_OVERSAMPLE 8
+
+/* Tournament (loser) tree over the runs of one part. node[0] holds the run
+ * with the current smallest element, node[1..k-1] the losers of each match.
+ * An exhausted run loses every match, so the merge ends once it wins.
+ */
+struct loser_tree {
+    size_t k;
+    size_t *node;
+    char **cur, **end;
+    size_t es;
+    cmp_t *cmp;
+    const void *priv;
+};
+
+static inline bool lt_beats(struct loser_tree *lt, size_t i, size_t j)
+{
+    int r;
+
+    if (lt->cur[i] == lt->end[i])
+        return false;
+    if (lt->cur[j] == lt->end[j])
+        return true;
+
+    /* if equal, take the earlier run -- important for sort stability */
+    r = lt->cmp(lt->cur[i], lt->cur[j], lt->priv);
+    return r < 0 || (r == 0 && i < j);
+}
+
+static size_t lt_build(struct loser_tree *lt, size_t pos)
+{
+    size_t a, b;
+
+    if (pos >= lt->k)
+        return pos - lt->k;
+
+    a = lt_build(lt, 2 * pos);
+    b = lt_build(lt, 2 * pos + 1);
+    if (lt_beats(lt, a, b)) {
+        lt->node[pos] = b;
+        return a;
+    }
+    lt->node[pos] = a;
+    return b;
+}
+
+static void lt_replay(struct loser_tree *lt)
+{
+    size_t w = lt->node[0];
+    size_t pos;
+
+    for (pos = (w + lt->k) / 2; pos; pos /= 2) {
+        if (lt_beats(lt, lt->node[pos], w))
+            swap(lt->node[pos], w);
+    }
+    lt->node[0] = w;
+}
+
+static void lt_merge(struct loser_tree *lt, char *dst)
+{
+    size_t w;
+    unsigned int work = 0;
+
+    lt->node[0] = lt->k > 1 ? lt_build(lt, 1) : 0;
+    for (w = lt->node[0]; lt->cur[w] != lt->end[w]; w = lt->node[0]) {
+        sort_resched(&work);
+        memcpy(dst, lt->cur[w], lt->es);
+        dst += lt->es;
+        lt->cur[w] += lt->es;
+        lt_replay(lt);
+    }
+}
+
+struct kway_part {
+    struct work_struct w;
+    struct loser_tree lt;
+    char *dst;
+};
+
+static void kway_part_func(struct work_struct *w)
+{
+    struct kway_part *part = container_of(w, struct kway_part, w);
+    ktime_t start = ktime_get();
+
+    lt_merge(&part->lt, part->dst);
+    sort_stats_account(start);
+}
+
+/* First element of [lo, hi) that is greater than key. */
+static char *upper_bound(char *lo,
+                         char *hi,
+                         size_t es,
+                         const void *key,
+                         cmp_t *cmp,
+                         const void *priv)
+{
+    size_t n = (hi - lo) / es;
+
+    while (n > 0) {
+        size_t half = n / 2;
+        char *mid = lo + half * es;
+
+        if (cmp(mid, key, priv) <= 0) {
+            lo = mid + es;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return lo;
+}
+
+/* Choose nr_parts - 1 splitter keys from a sample taken across all runs,
+ * proportionally to the run lengths. Run r covers [start[r], end[r]).
+ * Splitters are copied to the front of samples, which must hold
+ * nr_parts * KWAY_OVERSAMPLE + nr_runs elements.
+ */
+static void choose_splitters(char *const *start,
+                             char *const *end,
+                             size_t n,
+                             char *samples,
+                             size_t es,
+                             size_t nr_runs,
+                             size_t nr_parts,
+                             cmp_t *cmp,
+                             const void *priv)
+{
+    size_t want = nr_parts * KWAY_OVERSAMPLE;
+    size_t nr_samples = 0;
+    size_t r, j;
+
+    for (r = 0; r < nr_runs; r++) {
+        size_t len = (end[r] - start[r]) / es;
+        size_t cnt = min(DIV_ROUND_UP(want * len, n), len);
+
+        for (j = 0; j < cnt; j++) {
+            size_t pos = (2 * j + 1) * len / (2 * cnt);
+            memcpy(samples + nr_samples++ * es, start[r] + pos * es, es);
+        }
+    }
+
+    sort_r(samples, nr_samples, es, cmp, NULL, priv);
+
+    for (j = 1; j < nr_parts; j++)
+        memmove(samples + (j - 1) * es,
+                samples + (j * nr_samples / nr_parts) * es, es);
+}
+
+int kway_merge_runs(void *dst,
+                    char *const *start,
+                    char *const *end,
+                    size_t nr_runs,
+                    size_t es,
+                    cmp_t *cmp,
+                    const void *priv)
+{
+    size_t n = 0;
+    size_t nr_parts, p, r;
+    struct kway_part *parts;
+    char *samples, **cut, **cursors;
+    size_t *nodes;
+    void *mem;
+    int cpu = -1;
+
+    for (r = 0; r < nr_runs; r++)
+        n += (end[r] - start[r]) / es;
+    if (!n)
+        return 0;
+
+    nr_parts = clamp_t(size_t, n / KWAY_MIN_PART, 1, nr_sort_cpus());
+
+    /* cut[] holds the nr_parts + 1 boundaries of every run; each part then
+     * owns the cursors of its runs and the nodes of its loser tree.
+     */
+    mem = kvmalloc(nr_parts * sizeof(*parts) +
+                       (3 * nr_parts + 1) * nr_runs * sizeof(char *) +
+                       nr_parts * nr_runs * sizeof(size_t),
+                   GFP_KERNEL);
+    if (!mem)
+        return -ENOMEM;
+    parts = mem;
+    cut = (char **) (parts + nr_parts);
+    cursors = cut + (nr_parts + 1) * nr_runs;
+    nodes = (size_t *) (cursors + 2 * nr_parts * nr_runs);
+
+    for (r = 0; r < nr_runs; r++) {
+        cut[r] = start[r];
+        cut[nr_parts * nr_runs + r] = end[r];
+    }
+
+    if (nr_parts > 1) {
+        samples = kvmalloc((nr_parts * KWAY_OVERSAMPLE + nr_runs) * es,
+                           GFP_KERNEL);
+        if (!samples) {
+            kvfree(mem);
+            return -ENOMEM;
+        }
+        choose_splitters(start, end, n, samples, es, nr_runs, nr_parts, cmp,
+                         priv);
+
+        /* Equal keys never straddle two parts, which keeps them stable. */
+        for (p = 1; p < nr_parts; p++)
+            for (r = 0; r < nr_runs; r++)
+                cut[p * nr_runs + r] =
+                    upper_bound(cut[r], cut[nr_parts * nr_runs + r], es,
+                                samples + (p - 1) * es, cmp, priv);
+        kvfree(samples);
+    }
+
+    for (p = 0; p < nr_parts; p++) {
+        struct kway_part *part = &parts[p];
+        struct loser_tree *lt = &part->lt;
+        size_t off = 0;
+
+        lt->node = nodes + p * nr_runs;
+        lt->cur = cursors + 2 * p * nr_runs;
+        lt->end = lt->cur + nr_runs;
+        lt->es = es;
+        lt->cmp = cmp;
+        lt->priv = priv;
+        lt->k = 0;
+
+        /* Drop runs that are empty within this part; the order of the
+         * remaining ones still decides ties.
+         */
+        for (r = 0; r < nr_runs; r++) {
+            char *from = cut[p * nr_runs + r];
+            char *to = cut[(p + 1) * nr_runs + r];
+
+            off += from - cut[r];
+            if (from == to)
+                continue;
+            lt->cur[lt->k] = from;
+            lt->end[lt->k] = to;
+            lt->k++;
+        }
+        part->dst = (char *) dst + off;
+
+        INIT_WORK(&part->w, kway_part_func);
+        if (!lt->k)
+            continue;
+        cpu = next_online_cpu(cpu);
+        queue_work_on(cpu, workqueue, &part->w);
+    }
+
+    for (p = 0; p < nr_parts; p++)
+        flush_work(&parts[p].w);
+
+    kvfree(mem);
+    return 0;
+}
+
+int kway_merge(void *buf,
+               size_t es,
+               const size_t *bounds,
+               size_t nr_runs,
+               cmp_t *cmp,
+               const void *priv)
+{
+    size_t n = bounds[nr_runs] - bounds[0];
+    char *base = (char *) buf + bounds[0] * es;
+    char *tmp, **start;
+    size_t r;
+    int ret;
+
+    if (nr_runs <= 1 || n <= 1)
+        return 0;
+
+    tmp = kvmalloc(n * es, GFP_KERNEL);
+    if (!tmp)
+        return -ENOMEM;
+
+    start = kvmalloc_array(nr_runs + 1, sizeof(*start), GFP_KERNEL);
+    if (!start) {
+        kvfree(tmp);
+        return -ENOMEM;
+    }
+    for (r = 0; r <= nr_runs; r++)
+        start[r] = base + (bounds[r] - bounds[0]) * es;
+
+    /* Run r ends where run r + 1 starts. */
+    ret = kway_merge_runs(tmp, start, start + 1, nr_runs, es, cmp, priv);
+    if (!ret)
+        memcpy(base, tmp, n * es);
+
+    kvfree(start);
+    kvfree(tmp);
+    return ret;
+}
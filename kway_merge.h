@@ -0,0 +1,31 @@
+#ifndef KWAY_MERGE_H
+#define KWAY_MERGE_H
+
+#include <linux/types.h>
+
+#include "sort.h"
+
+/* Merge the nr_runs sorted runs of buf in place. Run i covers the elements
+ * [bounds[i], bounds[i + 1]), so bounds holds nr_runs + 1 entries. Equal
+ * elements keep the order of their runs, as merge() in timsort.c does.
+ */
+int kway_merge(void *buf,
+               size_t es,
+               const size_t *bounds,
+               size_t nr_runs,
+               cmp_t *cmp,
+               const void *priv);
+
+/* Merge the nr_runs sorted runs [start[i], end[i]) into dst, which must
+ * not overlap them. The runs may live in separate buffers; ties go to the
+ * lower run.
+ */
+int kway_merge_runs(void *dst,
+                    char *const *start,
+                    char *const *end,
+                    size_t nr_runs,
+                    size_t es,
+                    cmp_t *cmp,
+                    const void *priv);
+
+#endif  // KWAY_MERGE_H
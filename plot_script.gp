@@ -11,9 +11,22 @@ set ylabel "exectime (nanoseconds)"
 set datafile separator ','
 
 # 繪製折線圖
-plot "output.csv" using 1:2 with linespoints linewidth 2 title "Qsort_user", \
-     "output.csv" using 1:3 with linespoints linewidth 2 title "linuxsort_user", \
-     "output.csv" using 1:4 with linespoints linewidth 2 title "Timsort_user",\
-     "output.csv" using 1:5 with linespoints linewidth 2 title "Qsort_kernel", \
-     "output.csv" using 1:6 with linespoints linewidth 2 title "linuxsort_kernel", \
-     "output.csv" using 1:7 with linespoints linewidth 2 title "Timsort_kernel"
+# 以 gnuplot -e "bench='bench.csv'" 繪製 bench 的中位數
+if (exists("bench")) {
+    set output "bench.png"
+    set logscale xy
+    methods = "qsort timsort linuxsort inplace count"
+    plot for [m in methods] bench skip 1 \
+         using 3:(strcol(1) eq m ? $5 : 1/0) \
+         with linespoints linewidth 2 title m."_median", \
+         for [m in methods] bench skip 1 \
+         using 3:(strcol(1) eq m ? $6 : 1/0) \
+         with lines dashtype 2 title m."_p99"
+} else {
+    plot "output.csv" using 1:2 with linespoints linewidth 2 title "Qsort_user", \
+         "output.csv" using 1:3 with linespoints linewidth 2 title "Timsort_user", \
+         "output.csv" using 1:4 with linespoints linewidth 2 title "linuxsort_user",\
+         "output.csv" using 1:5 with linespoints linewidth 2 title "Qsort_kernel", \
+         "output.csv" using 1:6 with linespoints linewidth 2 title "Timsort_kernel", \
+         "output.csv" using 1:7 with linespoints linewidth 2 title "linuxsort_kernel"
+}
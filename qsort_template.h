@@ -0,0 +1,127 @@
+/* Body of the quicksort in sort_impl.c, included once per specialization.
+ * The includer defines:
+ *
+ *   QSORT_NAME(x)          name of the generated function x
+ *   QSORT_LOCALS           declarations from c: es, the element size, which
+ *                          may well be a constant, and whatever the macros
+ *                          below rely on
+ *   QSORT_CMP(x, y)        three-way comparison of the elements at x and y
+ *   QSORT_MED3(x, y, z)    the median of the elements at x, y and z
+ *   QSORT_SWAP(x, y)       swap of the elements at x and y
+ *   QSORT_VECSWAP(x, y, n) swap of the n bytes at x and y
+ *
+ * With a comparison the compiler can see, it is inlined into the partition
+ * loops instead of going through an indirect call. The macros are
+ * undefined at the end, ready for the next specialization.
+ */
+
+/* start is when the calling work item began, for its time slice. */
+static void QSORT_NAME(range)(void *a,
+                              size_t n,
+                              struct common *c,
+                              ktime_t start)
+{
+    char *pa, *pb, *pc, *pd, *pl, *pm, *pn;
+    int d, r, swap_cnt;
+    unsigned int work = 0;
+    size_t nl, nr;
+    QSORT_LOCALS
+top:
+    /* From here on qsort(3) business as usual. */
+    swap_cnt = 0;
+    if (n < 7) {
+        for (pm = (char *) a + es; pm < (char *) a + n * es; pm += es)
+            for (pl = pm; pl > (char *) a && QSORT_CMP(pl - es, pl) > 0;
+                 pl -= es)
+                QSORT_SWAP(pl, pl - es);
+        return;
+    }
+    pm = (char *) a + (n / 2) * es;
+    if (n > 7) {
+        pl = (char *) a;
+        pn = (char *) a + (n - 1) * es;
+        if (n > 40) {
+            d = (n / 8) * es;
+            pl = QSORT_MED3(pl, pl + d, pl + 2 * d);
+            pm = QSORT_MED3(pm - d, pm, pm + d);
+            pn = QSORT_MED3(pn - 2 * d, pn - d, pn);
+        }
+        pm = QSORT_MED3(pl, pm, pn);
+    }
+    QSORT_SWAP(a, pm);
+    pa = pb = (char *) a + es;
+
+    pc = pd = (char *) a + (n - 1) * es;
+    for (;;) {
+        while (pb <= pc && (r = QSORT_CMP(pb, a)) <= 0) {
+            sort_resched(&work);
+            if (r == 0) {
+                swap_cnt = 1;
+                QSORT_SWAP(pa, pb);
+                pa += es;
+            }
+            pb += es;
+        }
+        while (pb <= pc && (r = QSORT_CMP(pc, a)) >= 0) {
+            sort_resched(&work);
+            if (r == 0) {
+                swap_cnt = 1;
+                QSORT_SWAP(pc, pd);
+                pd -= es;
+            }
+            pc -= es;
+        }
+        if (pb > pc)
+            break;
+        QSORT_SWAP(pb, pc);
+        swap_cnt = 1;
+        pb += es;
+        pc -= es;
+    }
+
+    pn = (char *) a + n * es;
+    r = min(pa - (char *) a, pb - pa);
+    QSORT_VECSWAP(a, pb - r, r);
+    r = min(pd - pc, pn - pd - (long) es);
+    QSORT_VECSWAP(pb, pn - r, r);
+
+    if (swap_cnt == 0) { /* Switch to insertion sort */
+        r = 1 + n / 4;   /* n >= 7, so r >= 2 */
+        for (pm = (char *) a + es; pm < (char *) a + n * es; pm += es)
+            for (pl = pm; pl > (char *) a && QSORT_CMP(pl - es, pl) > 0;
+                 pl -= es) {
+                QSORT_SWAP(pl, pl - es);
+                if (++swap_cnt > r)
+                    goto nevermind;
+            }
+        return;
+    }
+
+nevermind:
+    nl = (pb - pa) / es;
+    nr = (pd - pc) / es;
+
+    if (nl > 100 && nr > 100) {
+        qsort_queue(a, nl, c);
+    } else if (nl > 0) {
+        QSORT_NAME(range)(a, nl, c, start);
+    }
+
+    if (nr > 0) {
+        a = pn - nr * es;
+        n = nr;
+        /* Out of time: leave the rest to a new work item. */
+        if (n > 100 && sort_slice_over(start)) {
+            qsort_queue(a, n, c);
+            return;
+        }
+        goto top;
+    }
+}
+
+#undef QSORT_NAME
+#undef QSORT_LOCALS
+#undef QSORT_CMP
+#undef QSORT_MED3
+#undef QSORT_SWAP
+#undef QSORT_VECSWAP
@@ -0,0 +1,255 @@
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/time.h>
+#include <linux/workqueue.h>
+
+#include "sample_split.h"
+#include "sort_stats.h"
+
+/* Parts smaller than this are not worth the extra pass over the data. */
+#define SPLIT_MIN_PART 8192
+
+/* Number of samples per part used to choose the splitters. */
+#define SPLIT_OVERSAMPLE 16
+
+struct split;
+
+/* One contiguous block of the input, handled by one work item in each
+ * phase. count[] holds its element count per part, then the offsets in
+ * tmp where its elements of each part go.
+ */
+struct split_block {
+    struct work_struct w;
+    struct split *s;
+    size_t start, end;
+    size_t *count;
+};
+
+struct split {
+    char *base, *tmp;
+    size_t es, nr_parts;
+    cmp_t *cmp;
+    const void *priv;
+    char *splitters; /* nr_parts - 1 elements */
+    size_t *first;   /* index of the first splitter equal to each one */
+    size_t *bounds;
+    struct split_block *blocks;
+};
+
+/* Index of the part elem of block b belongs to: the number of splitters
+ * not greater than elem. An element equal to splitters j .. lo - 1 may go
+ * to any part from j to lo, so such elements are spread over those parts
+ * by block. Later blocks take later parts, which keeps equal elements in
+ * their original order, and a key that fills many samples, as in
+ * few-unique or all-equal inputs, no longer lands in a single part.
+ */
+static size_t split_classify(const struct split *s,
+                             const void *elem,
+                             size_t b)
+{
+    size_t lo = 0, hi = s->nr_parts - 1, j;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+
+        if (s->cmp(s->splitters + mid * s->es, elem, s->priv) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (!lo || s->cmp(s->splitters + (lo - 1) * s->es, elem, s->priv))
+        return lo;
+    j = s->first[lo - 1];
+    return j + b * (lo - j + 1) / s->nr_parts;
+}
+
+static void split_count_func(struct work_struct *w)
+{
+    struct split_block *b = container_of(w, struct split_block, w);
+    const struct split *s = b->s;
+    ktime_t start = ktime_get();
+    unsigned int work = 0;
+    size_t i;
+
+    for (i = b->start; i < b->end; i++) {
+        sort_resched(&work);
+        b->count[split_classify(s, s->base + i * s->es, b - s->blocks)]++;
+    }
+    sort_stats_account(start);
+}
+
+static void split_scatter_func(struct work_struct *w)
+{
+    struct split_block *b = container_of(w, struct split_block, w);
+    const struct split *s = b->s;
+    ktime_t start = ktime_get();
+    unsigned int work = 0;
+    size_t i;
+
+    for (i = b->start; i < b->end; i++) {
+        const char *elem = s->base + i * s->es;
+        size_t p = split_classify(s, elem, b - s->blocks);
+
+        sort_resched(&work);
+        memcpy(s->tmp + b->count[p]++ * s->es, elem, s->es);
+    }
+    sort_stats_account(start);
+}
+
+/* Block i copies part i back, which needs every scatter to be done. The
+ * copy goes in pieces of SORT_RESCHED_BUDGET elements, as a part may hold
+ * most of the input.
+ */
+static void split_copy_func(struct work_struct *w)
+{
+    struct split_block *b = container_of(w, struct split_block, w);
+    const struct split *s = b->s;
+    size_t p = b - s->blocks;
+    size_t i, len, end = s->bounds[p + 1];
+    ktime_t start = ktime_get();
+
+    for (i = s->bounds[p]; i < end; i += len) {
+        len = min_t(size_t, end - i, SORT_RESCHED_BUDGET);
+        memcpy(s->base + i * s->es, s->tmp + i * s->es, len * s->es);
+        cond_resched();
+    }
+    sort_stats_account(start);
+}
+
+/* Run func on every block, one CPU each, and wait for all of them. */
+static void split_run(struct split *s, work_func_t func)
+{
+    size_t i;
+    int cpu = -1;
+
+    for (i = 0; i < s->nr_parts; i++) {
+        INIT_WORK(&s->blocks[i].w, func);
+        cpu = next_online_cpu(cpu);
+        queue_work_on(cpu, workqueue, &s->blocks[i].w);
+    }
+    for (i = 0; i < s->nr_parts; i++)
+        flush_work(&s->blocks[i].w);
+}
+
+/* Sample positions come from a fixed-seed splitmix64, so inputs with a
+ * period cannot line up with the samples and the split is reproducible.
+ */
+static u64 split_rand(u64 *x)
+{
+    u64 z = (*x += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void choose_splitters(struct split *s, char *samples, size_t n)
+{
+    size_t nr_samples = s->nr_parts * SPLIT_OVERSAMPLE;
+    u64 x = n;
+    size_t i;
+
+    for (i = 0; i < nr_samples; i++)
+        memcpy(samples + i * s->es, s->base + (split_rand(&x) % n) * s->es,
+               s->es);
+
+    sort_r(samples, nr_samples, s->es, s->cmp, NULL, s->priv);
+
+    for (i = 1; i < s->nr_parts; i++)
+        memcpy(s->splitters + (i - 1) * s->es,
+               samples + (i * SPLIT_OVERSAMPLE) * s->es, s->es);
+
+    s->first[0] = 0;
+    for (i = 1; i < s->nr_parts - 1; i++) {
+        const char *sp = s->splitters + i * s->es;
+
+        s->first[i] = s->cmp(sp - s->es, sp, s->priv) ? i : s->first[i - 1];
+    }
+}
+
+size_t sample_split_parts(size_t n)
+{
+    return clamp_t(size_t, n / SPLIT_MIN_PART, 1, nr_sort_cpus());
+}
+
+int sample_split(void *buf,
+                 size_t n,
+                 size_t es,
+                 cmp_t *cmp,
+                 const void *priv,
+                 size_t nr_parts,
+                 size_t *bounds)
+{
+    struct split s = {
+        .base = buf,
+        .es = es,
+        .nr_parts = nr_parts,
+        .cmp = cmp,
+        .priv = priv,
+        .bounds = bounds,
+    };
+    size_t i, p, off;
+    char *samples;
+    size_t *counts;
+
+    if (nr_parts <= 1 || n < nr_parts) {
+        bounds[0] = 0;
+        for (p = 1; p <= nr_parts; p++)
+            bounds[p] = n;
+        return 0;
+    }
+
+    s.tmp = kvmalloc_array(n, es, GFP_KERNEL);
+    s.blocks = kvmalloc_array(nr_parts, sizeof(*s.blocks), GFP_KERNEL);
+    counts = kvcalloc(nr_parts * nr_parts, sizeof(*counts), GFP_KERNEL);
+    s.first = kmalloc_array(nr_parts, sizeof(*s.first), GFP_KERNEL);
+    samples = kvmalloc_array(nr_parts * (SPLIT_OVERSAMPLE + 1), es,
+                             GFP_KERNEL);
+    if (!s.tmp || !s.blocks || !counts || !s.first || !samples) {
+        kvfree(samples);
+        kfree(s.first);
+        kvfree(counts);
+        kvfree(s.blocks);
+        kvfree(s.tmp);
+        return -ENOMEM;
+    }
+    s.splitters = samples + nr_parts * SPLIT_OVERSAMPLE * es;
+
+    choose_splitters(&s, samples, n);
+
+    for (i = 0; i < nr_parts; i++) {
+        s.blocks[i].s = &s;
+        s.blocks[i].start = n * i / nr_parts;
+        s.blocks[i].end = n * (i + 1) / nr_parts;
+        s.blocks[i].count = counts + i * nr_parts;
+    }
+
+    split_run(&s, split_count_func);
+
+    /* Parts are laid out in order, and within a part the blocks are, which
+     * keeps equal elements in their original order.
+     */
+    off = 0;
+    for (p = 0; p < nr_parts; p++) {
+        bounds[p] = off;
+        for (i = 0; i < nr_parts; i++) {
+            size_t cnt = s.blocks[i].count[p];
+
+            s.blocks[i].count[p] = off;
+            off += cnt;
+        }
+    }
+    bounds[nr_parts] = n;
+
+    split_run(&s, split_scatter_func);
+    split_run(&s, split_copy_func);
+
+    kvfree(samples);
+    kfree(s.first);
+    kvfree(counts);
+    kvfree(s.blocks);
+    kvfree(s.tmp);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef SAMPLE_SPLIT_H
+#define SAMPLE_SPLIT_H
+
+#include <linux/types.h>
+
+#include "sort.h"
+
+/* Number of parts worth splitting n elements into: at most one per CPU the
+ * engines may use, and none much smaller than SPLIT_MIN_PART elements.
+ */
+size_t sample_split_parts(size_t n);
+
+/* Rearrange the n elements of buf into nr_parts key ranges chosen from an
+ * oversampled set of splitters. Part i holds the elements
+ * [bounds[i], bounds[i + 1]), so bounds holds nr_parts + 1 entries, and
+ * none of them compares greater than an element of part i + 1. Elements
+ * equal to a splitter are spread over the parts around it, so inputs full
+ * of duplicates split too, and equal elements keep their original order.
+ * Counting and moving the elements run on the workqueue, one block per CPU.
+ * Returns 0, or -ENOMEM with buf untouched.
+ */
+int sample_split(void *buf,
+                 size_t n,
+                 size_t es,
+                 cmp_t *cmp,
+                 const void *priv,
+                 size_t nr_parts,
+                 size_t *bounds);
+
+#endif  // SAMPLE_SPLIT_H
@@ -1,17 +1,105 @@
 #ifndef KSORT_H
 #define KSORT_H
 
+#include <linux/cpumask.h>
+#include <linux/ktime.h>
+#include <linux/limits.h>
+#include <linux/sched.h>
 #include <linux/types.h>
 #include "sort_types.h"
 
-typedef int cmp_t(const void *, const void *);
+/* Same argument order as cmp_r_func_t, so comparators go to sort_r(). */
+typedef int cmp_t(const void *, const void *, const void *);
 
 
+/* Most bytes kvmalloc() hands out in one piece. Larger requests trip its
+ * WARN_ON_ONCE(), so buffers sized by the user are checked against this.
+ */
+#define SORT_MAX_ALLOC ((size_t) INT_MAX)
+
 extern struct workqueue_struct *workqueue;
 
+/* 0, or the number of the first CPU the engines may not queue work on. */
+extern unsigned int sort_cpu_limit;
+
+/* Longest a work item should run, in microseconds; 0 for no limit. */
+extern unsigned int sort_slice_us;
+
+int num_cmp(const void *a, const void *b, const void *priv);
+
+/* Compares records by the struct sort_layout passed as priv. */
+int layout_cmp(const void *a, const void *b, const void *priv);
+
+/* Round-robin over the online CPUs below sort_cpu_limit, starting after
+ * cpu.
+ */
+static inline int next_online_cpu(int cpu)
+{
+    unsigned int limit = READ_ONCE(sort_cpu_limit);
+    int end = limit && limit < nr_cpu_ids ? limit : nr_cpu_ids;
+
+    cpu = cpumask_next(cpu, cpu_online_mask);
+    return cpu < end ? cpu : cpumask_first(cpu_online_mask);
+}
+
+/* Number of CPUs next_online_cpu() cycles through. */
+static inline unsigned int nr_sort_cpus(void)
+{
+    unsigned int limit = READ_ONCE(sort_cpu_limit);
+    unsigned int nr = num_online_cpus();
+
+    return limit && limit < nr ? limit : nr;
+}
+
+/* Units of work, such as comparisons or elements moved, between two
+ * cond_resched() calls in the loops of the engines.
+ */
+#define SORT_RESCHED_BUDGET 4096
+
+/* Count one unit of work and offer the CPU once the budget is spent. */
+static inline void sort_resched(unsigned int *work)
+{
+    if (unlikely(++*work >= SORT_RESCHED_BUDGET)) {
+        *work = 0;
+        cond_resched();
+    }
+}
+
+/* Whether a work item that started at start has used up its time slice
+ * and should hand what is left to a new work item.
+ */
+static inline bool sort_slice_over(ktime_t start)
+{
+    unsigned int slice = READ_ONCE(sort_slice_us);
+
+    return slice && ktime_us_delta(ktime_get(), start) >= slice;
+}
+
+/* sort_r() with cond_resched() points. lib/sort.c has none of its own, so
+ * they come from a comparison wrapper on inputs large enough to need them.
+ */
+void sort_r_resched(void *base,
+                    size_t num,
+                    size_t size,
+                    cmp_t *cmp,
+                    const void *priv);
+
+/* Reduce the sorted ints in buf as output requests, in place. Returns the
+ * number of bytes left in buf, or a negative errno.
+ */
+ssize_t sort_output(void *buf, size_t size, sort_output_t output);
+
+/* Sort size elements of es bytes. A NULL layout means plain ints, which are
+ * the only elements the output modes apply to. *out_bytes receives the
+ * length of the output, or a negative errno such as -EOPNOTSUPP for a
+ * method that is not implemented.
+ */
 ktime_t sort_main(void *sort_buffer,
                   size_t size,
                   size_t es,
-                  sort_method_t sort_method);
+                  sort_method_t sort_method,
+                  const struct sort_layout *layout,
+                  sort_output_t output,
+                  ssize_t *out_bytes);
 
 #endif
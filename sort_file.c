@@ -0,0 +1,275 @@
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/time.h>
+
+#include "kway_merge.h"
+#include "sort.h"
+#include "sort_file.h"
+
+/* Buffer budget when the request leaves it to us. */
+#define FILE_DEFAULT_MEM (64UL << 20)
+
+/* kvmalloc() refuses anything larger. */
+#define FILE_MAX_MEM ((size_t) INT_MAX)
+
+/* A sorted run in the temporary file, read through a window. The elements
+ * [cur, len) of the window are still to be merged.
+ */
+struct file_run {
+    loff_t pos, end; /* unread bytes of the run in the temporary file */
+    char *buf;
+    size_t len, cur;
+};
+
+static int file_read(struct file *file, void *buf, size_t len, loff_t pos)
+{
+    while (len) {
+        ssize_t r = kernel_read(file, buf, min_t(size_t, len, MAX_RW_COUNT),
+                                &pos);
+
+        if (r < 0)
+            return r;
+        if (!r)
+            return -EIO; /* the file shrank under us */
+        buf = (char *) buf + r;
+        len -= r;
+    }
+    return 0;
+}
+
+static int file_write(struct file *file,
+                      const void *buf,
+                      size_t len,
+                      loff_t pos)
+{
+    while (len) {
+        ssize_t r = kernel_write(file, buf, min_t(size_t, len, MAX_RW_COUNT),
+                                 &pos);
+
+        if (r < 0)
+            return r;
+        if (!r)
+            return -EIO;
+        buf = (const char *) buf + r;
+        len -= r;
+    }
+    return 0;
+}
+
+static int file_check(struct file *file)
+{
+    if (!(file->f_mode & FMODE_READ) || !(file->f_mode & FMODE_WRITE))
+        return -EBADF;
+    /* kernel_write() would append every run instead of writing it in place. */
+    if (file->f_flags & O_APPEND)
+        return -EINVAL;
+    if (!S_ISREG(file_inode(file)->i_mode))
+        return -EINVAL;
+    return 0;
+}
+
+/* Number of the first n elements at base that go before key: those less
+ * than key, and with upper also those equal to it.
+ */
+static size_t file_bound(const char *base,
+                         size_t n,
+                         size_t es,
+                         const void *key,
+                         bool upper,
+                         cmp_t *cmp,
+                         const void *priv)
+{
+    size_t lo = 0;
+
+    while (n > 0) {
+        size_t half = n / 2;
+        int r = cmp(base + (lo + half) * es, key, priv);
+
+        if (r < 0 || (upper && r == 0)) {
+            lo += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return lo;
+}
+
+static int sort_run(void *buf,
+                    size_t n,
+                    size_t es,
+                    const struct sort_layout *layout,
+                    sort_method_t method)
+{
+    ssize_t bytes;
+
+    sort_main(buf, n, es, method, layout, SORT_OUTPUT_ALL, &bytes);
+    if (bytes < 0)
+        return bytes;
+
+    /* Anything short of the whole run would leave stale data in the file. */
+    return bytes == n * es ? 0 : -ENOMEM;
+}
+
+/* Merge the nr_runs runs of run_len elements in tmp into file, every run
+ * through a window of window elements. Each round refills the windows and
+ * merges what is certain to come before all unread elements: everything
+ * up to the smallest last element f among the windows of runs that go on.
+ * Elements equal to f are taken from the runs up to the first one whose
+ * window ends in f, as the later ones may only follow it.
+ */
+static int file_merge(struct file *file,
+                      struct file *tmp,
+                      size_t n,
+                      size_t es,
+                      size_t run_len,
+                      size_t nr_runs,
+                      size_t window,
+                      cmp_t *cmp,
+                      const void *priv)
+{
+    struct file_run *runs;
+    char *pool, *out, **start;
+    loff_t out_pos = 0;
+    size_t r;
+    int ret = -ENOMEM;
+
+    runs = kvcalloc(nr_runs, sizeof(*runs), GFP_KERNEL);
+    start = kvmalloc_array(2 * nr_runs, sizeof(*start), GFP_KERNEL);
+    pool = kvmalloc(2 * nr_runs * window * es, GFP_KERNEL);
+    if (!runs || !start || !pool)
+        goto out;
+    out = pool + nr_runs * window * es;
+
+    for (r = 0; r < nr_runs; r++) {
+        runs[r].pos = (loff_t) r * run_len * es;
+        runs[r].end = (loff_t) min(n, (r + 1) * run_len) * es;
+        runs[r].buf = pool + r * window * es;
+    }
+
+    for (;;) {
+        const char *f = NULL;
+        size_t rf = 0, total = 0;
+
+        for (r = 0; r < nr_runs; r++) {
+            struct file_run *run = &runs[r];
+            size_t rest = run->len - run->cur;
+            size_t more = min_t(size_t, window - rest,
+                                (run->end - run->pos) / es);
+
+            memmove(run->buf, run->buf + run->cur * es, rest * es);
+            ret = file_read(tmp, run->buf + rest * es, more * es, run->pos);
+            if (ret)
+                goto out;
+            run->pos += more * es;
+            run->cur = 0;
+            run->len = rest + more;
+
+            if (run->pos < run->end) {
+                const char *last = run->buf + (run->len - 1) * es;
+
+                if (!f || cmp(last, f, priv) < 0) {
+                    f = last;
+                    rf = r;
+                }
+            }
+        }
+
+        for (r = 0; r < nr_runs; r++) {
+            struct file_run *run = &runs[r];
+            size_t len = run->len;
+
+            if (f)
+                len = file_bound(run->buf, len, es, f, r <= rf, cmp, priv);
+            start[r] = run->buf;
+            start[nr_runs + r] = run->buf + len * es;
+            run->cur = len;
+            total += len;
+        }
+
+        ret = kway_merge_runs(out, start, start + nr_runs, nr_runs, es, cmp,
+                              priv);
+        if (!ret)
+            ret = file_write(file, out, total * es, out_pos);
+        if (ret || !f)
+            goto out;
+        out_pos += (loff_t) total * es;
+    }
+
+out:
+    kvfree(pool);
+    kvfree(start);
+    kvfree(runs);
+    return ret;
+}
+
+int sort_file(struct file *file,
+              struct file *tmp,
+              size_t es,
+              const struct sort_layout *layout,
+              sort_method_t method,
+              size_t mem_limit,
+              ktime_t *kt)
+{
+    loff_t size = i_size_read(file_inode(file));
+    cmp_t *cmp = layout ? layout_cmp : num_cmp;
+    size_t n, run_len, nr_runs, window = 0, r;
+    void *buf;
+    int ret;
+
+    ret = file_check(file);
+    if (ret)
+        return ret;
+    if (size % es)
+        return -EINVAL;
+
+    n = size / es;
+    mem_limit = min(mem_limit ? mem_limit : FILE_DEFAULT_MEM, FILE_MAX_MEM);
+    run_len = min(n, mem_limit / es);
+    if (!n)
+        return 0;
+    if (!run_len)
+        return -EINVAL;
+
+    nr_runs = DIV_ROUND_UP(n, run_len);
+    if (nr_runs > 1) {
+        if (!tmp)
+            return -EFBIG;
+        ret = file_check(tmp);
+        if (ret)
+            return ret;
+        if (file_inode(tmp) == file_inode(file))
+            return -EINVAL;
+
+        /* The merge needs a window per run and as much for its output. */
+        window = mem_limit / es / (2 * nr_runs);
+        if (!window)
+            return -EINVAL;
+    }
+
+    buf = kvmalloc(run_len * es, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    *kt = ktime_get();
+    for (r = 0; r < nr_runs; r++) {
+        loff_t pos = (loff_t) r * run_len * es;
+        size_t len = min(run_len, n - r * run_len);
+
+        ret = file_read(file, buf, len * es, pos);
+        if (!ret)
+            ret = sort_run(buf, len, es, layout, method);
+        if (!ret)
+            ret = file_write(nr_runs > 1 ? tmp : file, buf, len * es, pos);
+        if (ret)
+            break;
+    }
+    kvfree(buf);
+
+    if (!ret && nr_runs > 1)
+        ret = file_merge(file, tmp, n, es, run_len, nr_runs, window, cmp,
+                         layout);
+    *kt = ktime_sub(ktime_get(), *kt);
+    return ret;
+}
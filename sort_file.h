@@ -0,0 +1,25 @@
+#ifndef SORT_FILE_H
+#define SORT_FILE_H
+
+#include <linux/fs.h>
+#include <linux/types.h>
+
+#include "sort_types.h"
+
+/* Sort the elements of es bytes in file as SORT_IOC_FILE describes, with
+ * buffers of at most mem_limit bytes in all. Runs that fit are sorted by
+ * sort_main() with method; tmp, which may be NULL when the whole file
+ * fits, receives them for the merge. The merge reads every run through a
+ * window of its own and streams the output back to file in large
+ * sequential writes. A NULL layout means plain ints. Returns 0 or a
+ * negative errno; *kt receives the time taken.
+ */
+int sort_file(struct file *file,
+              struct file *tmp,
+              size_t es,
+              const struct sort_layout *layout,
+              sort_method_t method,
+              size_t mem_limit,
+              ktime_t *kt);
+
+#endif  // SORT_FILE_H
@@ -1,12 +1,21 @@
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/export.h>
 #include <linux/slab.h>
 #include <linux/sort.h>
+#include <linux/string.h>
 #include <linux/time.h>
 #include <linux/workqueue.h>
 
+#include "count_sort.h"
+#include "inplace_sort.h"
+#include "ksort_array.h"
+#include "sample_split.h"
 #include "sort.h"
+#include "sort_stats.h"
 #include "timsort.h"
 
-static inline char *med3(char *, char *, char *, cmp_t *, void *);
+static inline char *med3(char *, char *, char *, cmp_t *, const void *);
 static inline void swapfunc(char *, char *, int, int);
 
 /* Qsort routine from Bentley & McIlroy's "Engineering a Sort Function" */
@@ -28,29 +37,35 @@ static inline void swapfunc(char *a, char *b, int n, int swaptype)
         swapcode(long, a, b, n) else swapcode(char, a, b, n)
 }
 
+/* swaptype 3 hands every element swap to the caller's swap function. */
 #define q_swap(a, b)                       \
     do {                                   \
         if (swaptype == 0) {               \
             long t = *(long *) (a);        \
             *(long *) (a) = *(long *) (b); \
             *(long *) (b) = t;             \
-        } else                             \
+        } else if (swaptype == 3)          \
+            c->swap_func(a, b, es);        \
+        else                               \
             swapfunc(a, b, es, swaptype);  \
     } while (0)
 
-#define vecswap(a, b, n)                 \
-    do {                                 \
-        if ((n) > 0)                     \
-            swapfunc(a, b, n, swaptype); \
+#define vecswap(a, b, n)                                             \
+    do {                                                             \
+        if ((n) > 0 && swaptype == 3) {                              \
+            for (long i = 0; i < (n); i += es)                       \
+                c->swap_func((char *) (a) + i, (char *) (b) + i, es); \
+        } else if ((n) > 0)                                          \
+            swapfunc(a, b, n, swaptype);                             \
     } while (0)
 
-#define CMP(t, x, y) (cmp((x), (y)))
+#define CMP(t, x, y) (cmp((x), (y), (t)))
 
 static inline char *med3(char *a,
                          char *b,
                          char *c,
                          cmp_t *cmp,
-                         __attribute__((unused)) void *thunk)
+                         const void *thunk)
 {
     return CMP(thunk, a, b) < 0
                ? (CMP(thunk, b, c) < 0 ? b : (CMP(thunk, a, c) < 0 ? c : a))
@@ -58,11 +73,44 @@ static inline char *med3(char *a,
 }
 
 struct common {
-    int swaptype; /* Code to use for swapping */
-    size_t es;    /* Element size. */
-    cmp_t *cmp;   /* Comparison function */
+    int swaptype;          /* Code to use for swapping */
+    size_t es;             /* Element size. */
+    cmp_t *cmp;            /* Comparison function */
+    const void *priv;      /* Passed to every comparison */
+    int cpu;               /* Last CPU a work item was queued on */
+    swap_func_t swap_func; /* Caller's swap function for swaptype 3 */
+
+    /* A qsort completes done once its last work item finishes; it then
+     * frees owner, if any, which holds this struct.
+     */
+    atomic_t pending;
+    struct completion *done;
+    void *owner;
 };
 
+static int swap_type(const void *base, size_t es, swap_func_t swap)
+{
+    if (swap)
+        return 3;
+    return ((char *) base - (char *) 0) % sizeof(long) || es % sizeof(long)
+               ? 2
+           : es == sizeof(long) ? 0
+                                : 1;
+}
+
+/* Drop one reference to a qsort in flight. The completion is the last
+ * thing touched, as the waiter may free it right away.
+ */
+static void common_put(struct common *c)
+{
+    struct completion *done = c->done;
+
+    if (!atomic_dec_and_test(&c->pending))
+        return;
+    kfree(c->owner);
+    complete(done);
+}
+
 struct qsort {
     struct work_struct w;
     struct common *common;
@@ -70,8 +118,8 @@ struct qsort {
     size_t n;
 };
 
-#define thunk NULL
 static void qsort_algo(struct work_struct *w);
+static void qsort_range(void *a, size_t n, struct common *c, ktime_t start);
 
 static void init_qsort(struct qsort *q,
                        void *elems,
@@ -85,6 +133,7 @@ static void init_qsort(struct qsort *q,
 }
 
 
+/* Every struct qsort is queued once and freed by its own work function. */
 static void qsort_algo(struct work_struct *w)
 {
     // /* Pretend to simulate access to per-CPU data, disabling preemption
@@ -95,141 +144,229 @@ static void qsort_algo(struct work_struct *w)
     // put_cpu();
 
     struct qsort *qs = container_of(w, struct qsort, w);
+    ktime_t start = ktime_get();
 
-    bool do_free = true;
-    char *pa, *pb, *pc, *pd, *pl, *pm, *pn;
-    int d, r, swaptype, swap_cnt;
-    void *a;      /* Array of elements. */
-    size_t n, es; /* Number of elements; size. */
-    cmp_t *cmp;
-    size_t nl, nr;
-    struct common *c;
+    struct common *c = qs->common;
 
-    /* Initialize qsort arguments. */
-    c = qs->common;
-    es = c->es;
-    cmp = c->cmp;
-    swaptype = c->swaptype;
-    a = qs->a;
-    n = qs->n;
-top:
-    /* From here on qsort(3) business as usual. */
-    swap_cnt = 0;
-    if (n < 7) {
-        for (pm = (char *) a + es; pm < (char *) a + n * es; pm += es)
-            for (pl = pm; pl > (char *) a && CMP(thunk, pl - es, pl) > 0;
-                 pl -= es)
-                q_swap(pl, pl - es);
+    qsort_range(qs->a, qs->n, c, start);
+    kfree(qs);
+    sort_stats_account(start);
+    common_put(c);
+}
+
+/* Round-robin for the work items of one sort. Workers racing here may pick
+ * the same CPU, which only costs balance.
+ */
+static int common_next_cpu(struct common *c)
+{
+    int cpu = next_online_cpu(READ_ONCE(c->cpu));
+
+    WRITE_ONCE(c->cpu, cpu);
+    return cpu;
+}
+
+/* Sort a .. a + n on another CPU, or right here if out of memory. */
+static void qsort_queue(void *a, size_t n, struct common *c)
+{
+    struct qsort *q = kmalloc(sizeof(struct qsort), GFP_KERNEL);
+
+    if (!q) {
+        qsort_range(a, n, c, ktime_get());
         return;
     }
-    pm = (char *) a + (n / 2) * es;
-    if (n > 7) {
-        pl = (char *) a;
-        pn = (char *) a + (n - 1) * es;
-        if (n > 40) {
-            d = (n / 8) * es;
-            pl = med3(pl, pl + d, pl + 2 * d, cmp, thunk);
-            pm = med3(pm - d, pm, pm + d, cmp, thunk);
-            pn = med3(pn - 2 * d, pn - d, pn, cmp, thunk);
-        }
-        pm = med3(pl, pm, pn, cmp, thunk);
-    }
-    q_swap(a, pm);
-    pa = pb = (char *) a + es;
-
-    pc = pd = (char *) a + (n - 1) * es;
-    for (;;) {
-        while (pb <= pc && (r = CMP(thunk, pb, a)) <= 0) {
-            if (r == 0) {
-                swap_cnt = 1;
-                q_swap(pa, pb);
-                pa += es;
-            }
-            pb += es;
-        }
-        while (pb <= pc && (r = CMP(thunk, pc, a)) >= 0) {
-            if (r == 0) {
-                swap_cnt = 1;
-                q_swap(pc, pd);
-                pd -= es;
-            }
-            pc -= es;
+    atomic_inc(&c->pending);
+    init_qsort(q, a, n, c);
+    queue_work_on(common_next_cpu(c), workqueue, &q->w);
+}
+
+/* The generic quicksort: any element size, the caller's comparison and
+ * swap.
+ */
+#define QSORT_NAME(x) qsort_##x##_generic
+#define QSORT_LOCALS             \
+    size_t es = c->es;           \
+    int swaptype = c->swaptype;  \
+    cmp_t *cmp = c->cmp;         \
+    const void *thunk = c->priv;
+#define QSORT_CMP(x, y) CMP(thunk, x, y)
+#define QSORT_MED3(x, y, z) med3(x, y, z, cmp, thunk)
+#define QSORT_SWAP(x, y) q_swap(x, y)
+#define QSORT_VECSWAP(x, y, n) vecswap(x, y, n)
+#include "qsort_template.h"
+
+/* Plain ints in ascending order, the elements of every read() without a
+ * layout. Unlike num_cmp(), these inline into qsort_range_int().
+ */
+static inline int int_cmp(const char *x, const char *y)
+{
+    int a = *(const int *) x, b = *(const int *) y;
+
+    return (a > b) - (a < b);
+}
+
+static inline char *int_med3(char *a, char *b, char *c)
+{
+    return int_cmp(a, b) < 0
+               ? (int_cmp(b, c) < 0 ? b : (int_cmp(a, c) < 0 ? c : a))
+               : (int_cmp(b, c) > 0 ? b : (int_cmp(a, c) < 0 ? a : c));
+}
+
+static inline void int_vecswap(char *a, char *b, long n)
+{
+    int *pa = (int *) a, *pb = (int *) b;
+
+    for (; n > 0; n -= sizeof(int), pa++, pb++)
+        swap(*pa, *pb);
+}
+
+#define QSORT_NAME(x) qsort_##x##_int
+#define QSORT_LOCALS const size_t es = sizeof(int);
+#define QSORT_CMP(x, y) int_cmp(x, y)
+#define QSORT_MED3(x, y, z) int_med3(x, y, z)
+#define QSORT_SWAP(x, y) swap(*(int *) (x), *(int *) (y))
+#define QSORT_VECSWAP(x, y, n) int_vecswap(x, y, n)
+#include "qsort_template.h"
+
+/* Pick the specialization for a: only num_cmp() over aligned ints can skip
+ * the indirect calls.
+ */
+static void qsort_range(void *a, size_t n, struct common *c, ktime_t start)
+{
+    if (c->cmp == num_cmp && c->es == sizeof(int) && c->swaptype != 3 &&
+        !(((char *) a - (char *) 0) % sizeof(int)))
+        qsort_range_int(a, n, c, start);
+    else
+        qsort_range_generic(a, n, c, start);
+}
+
+/* The first partition pass over a large range would run on one CPU before
+ * any work fans out, so split it into one key range per CPU first and
+ * quicksort every range as its own work item. The split moves elements
+ * with memcpy(), so a caller's swap function rules it out. c->done is
+ * completed once everything is sorted.
+ */
+static void qsort_main(void *a, size_t n, struct common *c)
+{
+    size_t nr_parts = sample_split_parts(n);
+    size_t single[2] = {0, n};
+    size_t *bounds = single;
+    size_t p;
+
+    /* Held until every part is queued, so no part completes c early. */
+    atomic_set(&c->pending, 1);
+
+    if (nr_parts > 1 && !c->swap_func) {
+        bounds = kmalloc_array(nr_parts + 1, sizeof(*bounds), GFP_KERNEL);
+        if (!bounds ||
+            sample_split(a, n, c->es, c->cmp, c->priv, nr_parts, bounds)) {
+            kfree(bounds);
+            bounds = single;
+            nr_parts = 1;
         }
-        if (pb > pc)
-            break;
-        q_swap(pb, pc);
-        swap_cnt = 1;
-        pb += es;
-        pc -= es;
     }
 
-    pn = (char *) a + n * es;
-    r = min(pa - (char *) a, pb - pa);
-    vecswap(a, pb - r, r);
-    r = min(pd - pc, pn - pd - (long) es);
-    vecswap(pb, pn - r, r);
-
-    if (swap_cnt == 0) { /* Switch to insertion sort */
-        r = 1 + n / 4;   /* n >= 7, so r >= 2 */
-        for (pm = (char *) a + es; pm < (char *) a + n * es; pm += es)
-            for (pl = pm; pl > (char *) a && CMP(thunk, pl - es, pl) > 0;
-                 pl -= es) {
-                q_swap(pl, pl - es);
-                if (++swap_cnt > r)
-                    goto nevermind;
-            }
-        return;
-    }
+    for (p = 0; p < nr_parts; p++) {
+        size_t len = bounds[p + 1] - bounds[p];
 
-nevermind:
-    nl = (pb - pa) / es;
-    nr = (pd - pc) / es;
-
-    if (nl > 100 && nr > 100) {
-        struct qsort *q = kmalloc(sizeof(struct qsort), GFP_KERNEL);
-        init_qsort(q, a, nl, c);
-        queue_work(workqueue, &q->w);
-    } else if (nl > 0) {
-        qs->a = a;
-        qs->n = nl;
-        /* The struct qsort is used for recursive call, so don't free it in
-         * this iteration.
-         */
-        do_free = false;
-        qsort_algo(w);
+        if (len)
+            qsort_queue((char *) a + bounds[p] * c->es, len, c);
     }
 
-    if (nr > 0) {
-        a = pn - nr * es;
-        n = nr;
-        goto top;
+    if (bounds != single)
+        kfree(bounds);
+    common_put(c);
+}
+
+/* An asynchronous ksort_array() call, freed by its last work item. */
+struct ksort_array_req {
+    struct work_struct w;
+    struct common c;
+    void *base;
+    size_t num;
+};
+
+static int array_cmp(const void *a, const void *b, const void *priv)
+{
+    return ((cmp_func_t) priv)(a, b);
+}
+
+static void ksort_array_func(struct work_struct *w)
+{
+    struct ksort_array_req *req = container_of(w, struct ksort_array_req, w);
+
+    qsort_main(req->base, req->num, &req->c);
+}
+
+int ksort_array(void *base,
+                size_t num,
+                size_t size,
+                cmp_func_t cmp_func,
+                swap_func_t swap_func,
+                unsigned int flags,
+                struct completion *done)
+{
+    struct completion sync_done;
+    struct ksort_array_req *req;
+    struct common c = {
+        .swaptype = swap_type(base, size, swap_func),
+        .es = size,
+        .cmp = array_cmp,
+        .priv = cmp_func,
+        .cpu = -1,
+        .swap_func = swap_func,
+    };
+
+    if (!size || (flags & ~KSORT_ASYNC) || (flags & KSORT_ASYNC && !done))
+        return -EINVAL;
+
+    if (!(flags & KSORT_ASYNC)) {
+        init_completion(&sync_done);
+        c.done = &sync_done;
+        qsort_main(base, num, &c);
+        wait_for_completion(&sync_done);
+        return 0;
     }
 
-    if (do_free)
-        kfree(qs);
+    /* Even the split runs on the workqueue, so the caller never waits. */
+    req = kmalloc(sizeof(*req), GFP_KERNEL);
+    if (!req)
+        return -ENOMEM;
+    req->c = c;
+    req->c.done = done;
+    req->c.owner = req;
+    req->base = base;
+    req->num = num;
+    INIT_WORK(&req->w, ksort_array_func);
+    queue_work_on(next_online_cpu(-1), workqueue, &req->w);
+    return 0;
 }
+EXPORT_SYMBOL(ksort_array);
 
 /*timsort*/
 struct timsort {
     struct work_struct w;
     struct list_head *head;
     list_cmp_func_t cmp;
+    void *priv;
 };
 
 static void timsort_func(struct work_struct *w);
 
 static void init_timsort(struct timsort *t,
                          struct list_head *head,
-                         list_cmp_func_t cmp)
+                         list_cmp_func_t cmp,
+                         void *priv)
 {
     INIT_WORK(&t->w, timsort_func);
     t->head = head;
     t->cmp = cmp;
+    t->priv = priv;
 }
 
 static void timsort_func(struct work_struct *w)
 {
     struct timsort *ts = container_of(w, struct timsort, w);
+    ktime_t start = ktime_get();
 
     if (!ts->head) {
         printk(KERN_ERR "Error: ts->head is NULL\n");
@@ -248,21 +385,35 @@ static void timsort_func(struct work_struct *w)
     // pr_info("sort: [CPU#%d] %s\n", cpu, __func__);
     // put_cpu();
 
-    timsort_algo(NULL, ts->head, ts->cmp);
+    timsort_algo(ts->priv, ts->head, ts->cmp);
+    sort_stats_account(start);
 }
-/* Function for list */
-static void buf_to_list(struct list_head *head, void *buf, size_t size)
+/* Function for list. On failure the nodes linked so far are freed again
+ * and head is left empty.
+ */
+static int buf_to_list(struct list_head *head, void *buf, size_t size)
 {
     int *int_buf = (int *) buf;
+    unsigned int work = 0;
+
     for (size_t i = 0; i < size; i++) {
         element_t *new_node = kmalloc(sizeof(*new_node), GFP_KERNEL);
+        sort_resched(&work);
         if (!new_node) {
+            element_t *node, *safe;
+
             printk(KERN_ERR "Failed to allocate memory for new node\n");
-            return;
+            list_for_each_entry_safe (node, safe, head, list) {
+                sort_resched(&work);
+                list_del(&node->list);
+                kfree(node);
+            }
+            return -ENOMEM;
         }
         new_node->val = int_buf[i];
         list_add_tail(&new_node->list, head);
     }
+    return 0;
 }
 
 bool list_cmp(void *priv,
@@ -276,17 +427,209 @@ bool list_cmp(void *priv,
     element_t *b_entry = list_entry(b, element_t, list);
     return (a_entry->val > b_entry->val) ^ descend;
 }
-static void list_to_buf(struct list_head *head, void *buf, size_t size)
+
+/* Writer for the final pass over sorted keys. Apart from SORT_OUTPUT_ALL,
+ * every run of equal keys is written once, when the next key differs.
+ */
+struct output_state {
+    sort_output_t mode;
+    char *out;
+    size_t cap, len; /* bytes */
+    int key;
+    u32 count;
+};
+
+static void output_init(struct output_state *o,
+                        sort_output_t mode,
+                        void *out,
+                        size_t cap)
 {
-    int *int_buf = (int *) buf;
+    o->mode = mode;
+    o->out = out;
+    o->cap = cap;
+    o->len = 0;
+    o->key = 0;
+    o->count = 0;
+}
+
+static inline bool output_put(struct output_state *o,
+                              const void *src,
+                              size_t es)
+{
+    if (o->cap - o->len < es)
+        return false;
+    memcpy(o->out + o->len, src, es);
+    o->len += es;
+    return true;
+}
+
+static inline bool output_flush(struct output_state *o)
+{
+    struct sort_key_count kc = {.key = o->key, .count = o->count};
+
+    if (!o->count)
+        return true;
+    o->count = 0;
+    if (o->mode == SORT_OUTPUT_COUNT)
+        return output_put(o, &kc, sizeof(kc));
+    return output_put(o, &kc.key, sizeof(kc.key));
+}
+
+static inline bool output_push(struct output_state *o, int key)
+{
+    if (o->mode == SORT_OUTPUT_ALL)
+        return output_put(o, &key, sizeof(key));
+
+    if (o->count && key == o->key) {
+        o->count++;
+        return true;
+    }
+    if (!output_flush(o))
+        return false;
+    o->key = key;
+    o->count = 1;
+    return true;
+}
+
+ssize_t sort_output(void *buf, size_t size, sort_output_t output)
+{
+    struct output_state o;
+    int *in = buf;
+    void *out = buf;
+    size_t i;
+    ssize_t ret;
+    unsigned int work = 0;
+
+    if (output == SORT_OUTPUT_ALL)
+        return size * sizeof(int);
+
+    /* A (key, count) pair is wider than the key it replaces, so the pairs
+     * cannot be written over keys that are yet to be read.
+     */
+    if (output == SORT_OUTPUT_COUNT) {
+        out = kvmalloc_array(size, sizeof(int), GFP_KERNEL);
+        if (!out)
+            return -ENOMEM;
+    }
+
+    output_init(&o, output, out, size * sizeof(int));
+    for (i = 0; i < size; i++) {
+        sort_resched(&work);
+        if (!output_push(&o, in[i]))
+            break;
+    }
+    if (i < size || !output_flush(&o)) {
+        ret = -EOVERFLOW;
+        goto out;
+    }
+
+    ret = o.len;
+    if (out != buf)
+        memcpy(buf, out, o.len);
+out:
+    if (out != buf)
+        kvfree(out);
+    return ret;
+}
+
+/* Records are linked in place and only copied once they are in order. */
+struct record_cmp {
+    cmp_t *cmp;
+    const void *priv;
+};
+
+/* Link every record of buf into head. On failure the nodes linked so far
+ * are freed again and head is left empty.
+ */
+static int buf_to_records(struct list_head *head,
+                          void *buf,
+                          size_t size,
+                          size_t es)
+{
+    unsigned int work = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        record_t *new_node = kmalloc(sizeof(*new_node), GFP_KERNEL);
+        sort_resched(&work);
+        if (!new_node) {
+            record_t *node, *safe;
+
+            printk(KERN_ERR "Failed to allocate memory for new node\n");
+            list_for_each_entry_safe (node, safe, head, list) {
+                sort_resched(&work);
+                list_del(&node->list);
+                kfree(node);
+            }
+            return -ENOMEM;
+        }
+        new_node->rec = (char *) buf + i * es;
+        list_add_tail(&new_node->list, head);
+    }
+    return 0;
+}
+
+static bool record_list_cmp(void *priv,
+                            struct list_head *a,
+                            struct list_head *b,
+                            bool descend)
+{
+    struct record_cmp *rc = priv;
+    record_t *a_entry = list_entry(a, record_t, list);
+    record_t *b_entry = list_entry(b, record_t, list);
+    return (rc->cmp(a_entry->rec, b_entry->rec, rc->priv) > 0) ^ descend;
+}
+
+/* Gather the records in list order and free the list. */
+static ssize_t records_to_buf(struct list_head *head,
+                              void *buf,
+                              size_t size,
+                              size_t es)
+{
+    char *tmp = kvmalloc_array(size, es, GFP_KERNEL);
+    record_t *node, *safe;
+    size_t i = 0;
+    unsigned int work = 0;
+
+    list_for_each_entry_safe (node, safe, head, list) {
+        sort_resched(&work);
+        if (tmp)
+            memcpy(tmp + i++ * es, node->rec, es);
+        list_del(&node->list);
+        kfree(node);
+    }
+    if (!tmp)
+        return -ENOMEM;
+
+    /* Only what the list held: the rest of tmp was never written. */
+    memcpy(buf, tmp, i * es);
+    kvfree(tmp);
+    return i * es;
+}
+
+/* The final pass over the sorted list writes the requested output directly,
+ * so duplicates never reach the buffer.
+ */
+static ssize_t list_to_buf(struct list_head *head,
+                           void *buf,
+                           size_t size,
+                           sort_output_t output)
+{
+    struct output_state o;
     struct list_head *pos;
     element_t *entry;
-    size_t i = 0;
+    unsigned int work = 0;
 
+    output_init(&o, output, buf, size * sizeof(int));
     list_for_each (pos, head) {
+        sort_resched(&work);
         entry = list_entry(pos, element_t, list);
-        int_buf[i++] = entry->val;
+        if (!output_push(&o, entry->val))
+            return -EOVERFLOW;
     }
+    if (!output_flush(&o))
+        return -EOVERFLOW;
+
+    return o.len;
 }
 /*linux sort.h*/
 struct linuxsort {
@@ -312,6 +655,7 @@ static void init_linuxsort(struct linuxsort *ls,
 static void linuxsort_algo(struct work_struct *w)
 {
     struct linuxsort *ls = container_of(w, struct linuxsort, w);
+    ktime_t start = ktime_get();
 
     void *a;  /* Array of elements. */
     size_t n; /* Number of elements; size. */
@@ -331,26 +675,168 @@ static void linuxsort_algo(struct work_struct *w)
     // pr_info("sort: [CPU#%d] %s\n", cpu, __func__);
     // put_cpu();
 
-    sort(a, n, sizeof(int), cmp, NULL);
+    sort_r_resched(a, n, c->es, cmp, c->priv);
+    sort_stats_account(start);
+}
+
+/* Sample sort: split the buffer into one key range per CPU, then sort_r()
+ * every range on its own CPU. Small inputs stay in a single range, which
+ * sorts on one worker as before.
+ */
+static void linuxsort_main(void *a, size_t n, struct common *c)
+{
+    size_t nr_parts = sample_split_parts(n);
+    size_t *bounds = kmalloc_array(nr_parts + 1, sizeof(*bounds), GFP_KERNEL);
+    struct linuxsort *ls = kmalloc_array(nr_parts, sizeof(*ls), GFP_KERNEL);
+    int cpu = -1;
+    size_t p;
+
+    if (!bounds || !ls) {
+        sort_r(a, n, c->es, c->cmp, NULL, c->priv);
+        goto out;
+    }
+
+    if (sample_split(a, n, c->es, c->cmp, c->priv, nr_parts, bounds)) {
+        /* No memory for the split; sort it all on one worker. */
+        nr_parts = 1;
+        bounds[0] = 0;
+        bounds[1] = n;
+    }
+
+    for (p = 0; p < nr_parts; p++) {
+        init_linuxsort(&ls[p], (char *) a + bounds[p] * c->es,
+                       bounds[p + 1] - bounds[p], c);
+        if (!ls[p].n)
+            continue;
+        cpu = next_online_cpu(cpu);
+        queue_work_on(cpu, workqueue, &ls[p].w);
+    }
+    for (p = 0; p < nr_parts; p++)
+        flush_work(&ls[p].w);
+out:
+    kfree(ls);
+    kfree(bounds);
 }
 
-int num_cmp(const void *a, const void *b)
+struct resched_cmp {
+    cmp_t *cmp;
+    const void *priv;
+    unsigned int work;
+};
+
+static int resched_cmp(const void *a, const void *b, const void *priv)
 {
-    return (*(int *) a - *(int *) b);
+    struct resched_cmp *rc = (struct resched_cmp *) priv;
+
+    sort_resched(&rc->work);
+    return rc->cmp(a, b, rc->priv);
+}
+
+void sort_r_resched(void *base,
+                    size_t num,
+                    size_t size,
+                    cmp_t *cmp,
+                    const void *priv)
+{
+    struct resched_cmp rc = {.cmp = cmp, .priv = priv};
+
+    if (num < SORT_RESCHED_BUDGET) {
+        sort_r(base, num, size, cmp, NULL, priv);
+        return;
+    }
+    sort_r(base, num, size, resched_cmp, NULL, &rc);
+}
+
+int num_cmp(const void *a, const void *b, const void *priv)
+{
+    int x = *(int *) a, y = *(int *) b;
+
+    /* Subtracting would overflow for keys of opposite sign. */
+    return (x > y) - (x < y);
+}
+
+static int field_cmp(const void *a, const void *b, const struct sort_key *key)
+{
+    union {
+        u8 u8;
+        u16 u16;
+        u32 u32;
+        u64 u64;
+    } x, y;
+
+    /* Keys inside packed records need not be aligned. */
+    memcpy(&x, a, key->width);
+    memcpy(&y, b, key->width);
+
+#define FIELD_CMP(utype, stype)                                 \
+    (key->is_signed ? ((stype) x.utype > (stype) y.utype) -    \
+                          ((stype) x.utype < (stype) y.utype)   \
+                    : (x.utype > y.utype) - (x.utype < y.utype))
+
+    switch (key->width) {
+    case 1:
+        return FIELD_CMP(u8, s8);
+    case 2:
+        return FIELD_CMP(u16, s16);
+    case 4:
+        return FIELD_CMP(u32, s32);
+    default:
+        return FIELD_CMP(u64, s64);
+    }
+#undef FIELD_CMP
+}
+
+int layout_cmp(const void *a, const void *b, const void *priv)
+{
+    const struct sort_layout *layout = priv;
+    u32 i;
+
+    for (i = 0; i < layout->nr_keys; i++) {
+        const struct sort_key *key = &layout->keys[i];
+        int r = field_cmp((const char *) a + key->offset,
+                          (const char *) b + key->offset, key);
+        if (r)
+            return key->descend ? -r : r;
+    }
+    return 0;
+}
+
+/* qsort_main() for a caller that waits: c->done lives on this stack, and
+ * the work items must not outlive it.
+ */
+static void qsort_sync(void *a, size_t n, struct common *c)
+{
+    struct completion done;
+
+    c->swaptype = swap_type(a, c->es, NULL);
+    init_completion(&done);
+    c->done = &done;
+    qsort_main(a, n, c);
+    wait_for_completion(&done);
 }
 
 ktime_t sort_main(void *sort_buffer,
                   size_t size,
                   size_t es,
-                  sort_method_t sort_method)
+                  sort_method_t sort_method,
+                  const struct sort_layout *layout,
+                  sort_output_t output,
+                  ssize_t *out_bytes)
 {
     /* The allocation must be dynamic so that the pointer can be reliably freed
      * within the work function.
      */
-    int cpu_id = 15;
+    int cpu_id = next_online_cpu(-1);
     static ktime_t kt;  // evaluate kernal module sorting time
 
-    struct common common;
+    struct common common = {
+        .es = es,
+        .cmp = layout ? layout_cmp : num_cmp,
+        .priv = layout,
+        .cpu = cpu_id,
+    };
+    struct record_cmp rc = {.cmp = layout_cmp, .priv = layout};
+
     switch (sort_method) {
     case TIMSORT:
         printk(KERN_INFO "Do TIMSORT\n");
@@ -359,76 +845,106 @@ ktime_t sort_main(void *sort_buffer,
 
         struct list_head *head =
             (struct list_head *) kmalloc(sizeof(*head), GFP_KERNEL);
-        INIT_LIST_HEAD(head);
 
-        buf_to_list(head, sort_buffer, size);
+        /* A list missing some elements would come back as a short read. */
+        if (!t || !head) {
+            *out_bytes = -ENOMEM;
+        } else {
+            INIT_LIST_HEAD(head);
+            *out_bytes = layout ? buf_to_records(head, sort_buffer, size, es)
+                                : buf_to_list(head, sort_buffer, size);
+        }
+        if (*out_bytes < 0) {
+            kfree(head);
+            kfree(t);
+            return 0;
+        }
 
-        init_timsort(t, head, list_cmp);
+        if (layout)
+            init_timsort(t, head, record_list_cmp, &rc);
+        else
+            init_timsort(t, head, list_cmp, NULL);
 
         kt = ktime_get(); /*sorting time*/
         queue_work_on(cpu_id, workqueue, &t->w);
         // queue_work(workqueue, &t->w); if dont want task work on Specify cpu
-        drain_workqueue(workqueue);
+
+        /* Only wait for this sort: draining the shared workqueue would also
+         * wait for, and refuse new work from, the sorts of other files.
+         */
+        flush_work(&t->w);
         kt = ktime_sub(ktime_get(), kt);
 
-        list_to_buf(head, sort_buffer, size);
+        kfree(t);
+
+        if (layout) {
+            *out_bytes = records_to_buf(head, sort_buffer, size, es);
+            kfree(head);
+            break;
+        }
+
+        *out_bytes = list_to_buf(head, sort_buffer, size, output);
 
         /* Free list */
         element_t *node, *safe;
+        unsigned int work = 0;
         list_for_each_entry_safe (node, safe, head, list) {
+            sort_resched(&work);
             list_del(&node->list);
             kfree(node);
         }
+        kfree(head);
         break;
     case LINUX_SORT:
         printk(KERN_INFO "Do LINUXSORT\n");
 
-        struct linuxsort *ls = kmalloc(sizeof(struct linuxsort), GFP_KERNEL);
-
-        common.cmp = num_cmp;
+        kt = ktime_get(); /*sorting time*/
+        linuxsort_main(sort_buffer, size, &common);
+        kt = ktime_sub(ktime_get(), kt);
 
-        init_linuxsort(ls, sort_buffer, size, &common);
+        break;
+    case INPLACE_SORT:
+        printk(KERN_INFO "Do INPLACE_SORT\n");
 
         kt = ktime_get(); /*sorting time*/
-        queue_work_on(cpu_id, workqueue, &ls->w);
-        // queue_work(workqueue, &ls->w); if dont want task work on Specify cpu
-        drain_workqueue(workqueue);
+        inplace_sort(sort_buffer, size, es, common.cmp, common.priv);
         kt = ktime_sub(ktime_get(), kt);
 
+        break;
+    case COUNT_SORT:
+        printk(KERN_INFO "Do COUNT_SORT\n");
+
+        /* Records, and keys too far apart to count, go to quicksort. The
+         * pass that found the range out counts towards the time.
+         */
+        kt = ktime_get();
+        if (layout || count_sort(sort_buffer, size))
+            qsort_sync(sort_buffer, size, &common);
+        kt = ktime_sub(ktime_get(), kt);
         break;
     case QSORT:
         printk(KERN_INFO "Do QSORT\n");
 
-        struct qsort *q = kmalloc(sizeof(struct qsort), GFP_KERNEL);
-
-        common.swaptype = ((char *) sort_buffer - (char *) 0) % sizeof(long) ||
-                                  es % sizeof(long)
-                              ? 2
-                          : es == sizeof(long) ? 0
-                                               : 1;
-        common.es = es;
-        common.cmp = num_cmp;
-
-        init_qsort(q, sort_buffer, size, &common);
-
         kt = ktime_get();
-        queue_work_on(cpu_id, workqueue, &q->w);
-        // queue_work_on(workqueue, &q->w); if dont want task work on Specify
-        // cpu
-
-        /* Ensure completion of all work before proceeding, as reliance on
-         * objects allocated on the stack necessitates this. If not, there is a
-         * risk of the work item referencing a pointer that has ceased to exist.
-         */
-        drain_workqueue(workqueue);
+        qsort_sync(sort_buffer, size, &common);
         kt = ktime_sub(ktime_get(), kt);
         break;
     case PDQSORT:
-        printk(KERN_INFO "Start sorting: pdqsort\n");
-        break;
+        /* Not implemented yet: fail rather than hand back the input. */
+        printk(KERN_INFO "pdqsort is not supported\n");
+        *out_bytes = -EOPNOTSUPP;
+        return 0;
     default:
         printk(KERN_WARNING "Unknown sort method selected\n");
-        break;
+        *out_bytes = -EINVAL;
+        return 0;
     }
+
+    if (sort_method == TIMSORT)
+        return kt;
+    if (layout)
+        *out_bytes = size * es;
+    else
+        *out_bytes = sort_output(sort_buffer, size, output);
     return kt;
 }
@@ -0,0 +1,326 @@
+/* KUnit suite for the sort engines: every sort_method_t against sort_r()
+ * as the reference, over adversarial and duplicate-heavy inputs, plus
+ * stability and throughput. Built into sort.ko by "make KUNIT=1"; the
+ * suite runs every time the module is loaded.
+ */
+
+#include <kunit/test.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/time.h>
+#include <linux/version.h>
+
+#include "sort.h"
+
+/* Before 6.0, kunit_test_suite() in a module defines a module_init() of its
+ * own, which clashes with sort_init().
+ */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 0, 0)
+#error "The KUnit suite needs Linux 6.0 or later"
+#endif
+
+static const sort_method_t methods[] = {
+    QSORT, TIMSORT, PDQSORT, LINUX_SORT, INPLACE_SORT, COUNT_SORT,
+};
+
+static void method_desc(const sort_method_t *method, char *desc)
+{
+    strscpy(desc, get_sort_method_name(*method), KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(method, methods, method_desc);
+
+static bool is_stable(sort_method_t method)
+{
+    return method == TIMSORT || method == INPLACE_SORT;
+}
+
+typedef enum {
+    DIST_RANDOM,
+    DIST_SORTED,
+    DIST_REVERSE,
+    DIST_NEARLY_SORTED,
+    DIST_FEW_UNIQUE,
+    DIST_ALL_EQUAL,
+    DIST_SAWTOOTH,
+    DIST_ORGAN_PIPE,
+    DIST_INTERLEAVED, /* 0, n-1, 1, n-2, ...: median-of-three worst case */
+    DIST_EXTREMES,    /* INT_MIN and INT_MAX, which break subtraction */
+    DIST_MAX
+} dist_t;
+
+static const char *const dist_names[DIST_MAX] = {
+    "random",    "sorted",   "reverse",    "nearly-sorted", "few-unique",
+    "all-equal", "sawtooth", "organ-pipe", "interleaved",   "extremes",
+};
+
+/* Sizes around the insertion sort and work item thresholds of the engines.
+ * sort_test_throughput() goes on to 10^7.
+ */
+static const size_t sizes[] = {0, 1, 2, 3, 7, 8, 41, 100, 1000, 4097, 20000,
+                               100000};
+
+static u64 splitmix64(u64 *x)
+{
+    u64 z = (*x += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void fill(int *a, size_t n, dist_t dist, u64 seed)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        switch (dist) {
+        case DIST_RANDOM:
+            a[i] = (int) splitmix64(&seed);
+            break;
+        case DIST_SORTED:
+        case DIST_NEARLY_SORTED:
+            a[i] = i;
+            break;
+        case DIST_REVERSE:
+            a[i] = n - i;
+            break;
+        case DIST_FEW_UNIQUE:
+            a[i] = splitmix64(&seed) % 8;
+            break;
+        case DIST_ALL_EQUAL:
+            a[i] = 42;
+            break;
+        case DIST_SAWTOOTH:
+            a[i] = i % 64;
+            break;
+        case DIST_ORGAN_PIPE:
+            a[i] = i < n / 2 ? i : n - i;
+            break;
+        case DIST_INTERLEAVED:
+            a[i] = i % 2 ? n - 1 - i / 2 : i / 2;
+            break;
+        case DIST_EXTREMES:
+        default:
+            a[i] = splitmix64(&seed) & 1 ? INT_MAX : INT_MIN;
+        }
+    }
+
+    if (dist == DIST_NEARLY_SORTED) {
+        for (i = 0; n && i < n / 100 + 1; i++)
+            swap(a[splitmix64(&seed) % n], a[splitmix64(&seed) % n]);
+    }
+}
+
+/* Sort a copy of in with method and compare it with sort_r() on another. */
+static void check_ints(struct kunit *test,
+                       sort_method_t method,
+                       const int *in,
+                       size_t n,
+                       const char *what)
+{
+    int *got = kvmalloc_array(n + 1, sizeof(int), GFP_KERNEL);
+    int *want = kvmalloc_array(n + 1, sizeof(int), GFP_KERNEL);
+    ssize_t bytes;
+
+    if (!got || !want) {
+        KUNIT_FAIL(test, "no memory for %zu elements", n);
+        goto out;
+    }
+    memcpy(got, in, n * sizeof(int));
+    memcpy(want, in, n * sizeof(int));
+    sort_r(want, n, sizeof(int), num_cmp, NULL, NULL);
+
+    sort_main(got, n, sizeof(int), method, NULL, SORT_OUTPUT_ALL, &bytes);
+    if (method == PDQSORT) {
+        KUNIT_EXPECT_EQ(test, bytes, (ssize_t) -EOPNOTSUPP);
+        goto out;
+    }
+    KUNIT_EXPECT_EQ_MSG(test, bytes, (ssize_t) (n * sizeof(int)), "%s n=%zu",
+                        what, n);
+    KUNIT_EXPECT_EQ_MSG(test, memcmp(got, want, n * sizeof(int)), 0,
+                        "%s n=%zu", what, n);
+out:
+    kvfree(want);
+    kvfree(got);
+}
+
+static void sort_test_distributions(struct kunit *test)
+{
+    sort_method_t method = *(const sort_method_t *) test->param_value;
+    size_t max = sizes[ARRAY_SIZE(sizes) - 1];
+    int *in = kvmalloc_array(max, sizeof(int), GFP_KERNEL);
+    size_t i;
+    dist_t d;
+
+    KUNIT_ASSERT_NOT_NULL(test, in);
+    for (d = 0; d < DIST_MAX; d++) {
+        for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+            fill(in, sizes[i], d, d * 1000 + i);
+            check_ints(test, method, in, sizes[i], dist_names[d]);
+        }
+    }
+    kvfree(in);
+}
+
+struct rec {
+    s32 key;
+    u32 seq;
+};
+
+static const struct sort_layout rec_layout = {
+    .es = sizeof(struct rec),
+    .nr_keys = 1,
+    .keys = {{.offset = offsetof(struct rec, key), .width = 4, .is_signed = 1}},
+};
+
+/* The stable order: by key, then by input position. */
+static int rec_cmp(const void *a, const void *b, const void *priv)
+{
+    const struct rec *x = a, *y = b;
+
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/* Records with few distinct keys, each tagged with its input position.
+ * Every method must order the keys; the stable ones must also keep equal
+ * keys in input order.
+ */
+static void sort_test_stability(struct kunit *test)
+{
+    sort_method_t method = *(const sort_method_t *) test->param_value;
+    const size_t n = 50000;
+    struct rec *got = kvmalloc_array(n, sizeof(*got), GFP_KERNEL);
+    struct rec *want = kvmalloc_array(n, sizeof(*want), GFP_KERNEL);
+    unsigned int nr_keys[] = {1, 2, 16, 1000};
+    ssize_t bytes;
+    size_t i, k;
+    u64 seed = 7;
+
+    if (!got || !want) {
+        kvfree(want);
+        kvfree(got);
+        KUNIT_FAIL(test, "no memory for %zu records", n);
+        return;
+    }
+
+    for (k = 0; k < ARRAY_SIZE(nr_keys); k++) {
+        for (i = 0; i < n; i++) {
+            got[i].key = splitmix64(&seed) % nr_keys[k];
+            got[i].seq = i;
+        }
+        memcpy(want, got, n * sizeof(*got));
+        sort_r(want, n, sizeof(*want), rec_cmp, NULL, NULL);
+
+        sort_main(got, n, sizeof(*got), method, &rec_layout, SORT_OUTPUT_ALL,
+                  &bytes);
+        if (method == PDQSORT) {
+            KUNIT_EXPECT_EQ(test, bytes, (ssize_t) -EOPNOTSUPP);
+            continue;
+        }
+        KUNIT_EXPECT_EQ(test, bytes, (ssize_t) (n * sizeof(*got)));
+
+        for (i = 0; i < n; i++) {
+            if (got[i].key != want[i].key ||
+                (is_stable(method) && got[i].seq != want[i].seq))
+                break;
+        }
+        KUNIT_EXPECT_EQ_MSG(test, i, n, "%u keys: first mismatch at %zu",
+                            nr_keys[k], i);
+    }
+    kvfree(want);
+    kvfree(got);
+}
+
+/* A key must lie within the record, whatever the widths and offsets. */
+static void sort_test_layout_valid(struct kunit *test)
+{
+    struct sort_layout layout = {
+        .es = 2,
+        .nr_keys = 1,
+        .keys = {{.offset = 0, .width = 8}},
+    };
+
+    KUNIT_EXPECT_FALSE(test, is_valid_sort_layout(&layout));
+    layout.keys[0].width = 2;
+    KUNIT_EXPECT_TRUE(test, is_valid_sort_layout(&layout));
+    layout.keys[0].offset = 1;
+    KUNIT_EXPECT_FALSE(test, is_valid_sort_layout(&layout));
+    layout.keys[0].width = 0;
+    layout.keys[0].offset = 0;
+    KUNIT_EXPECT_FALSE(test, is_valid_sort_layout(&layout));
+    KUNIT_EXPECT_TRUE(test, is_valid_sort_layout(&rec_layout));
+}
+
+/* Random ints up to 10^7 elements, reported in elements per millisecond.
+ * The output is only checked to be in order and to keep the sum of the
+ * input, as sort_r() on 10^7 elements would take longer than the engines.
+ */
+static void sort_test_throughput(struct kunit *test)
+{
+    sort_method_t method = *(const sort_method_t *) test->param_value;
+    size_t n, i;
+
+    if (method == PDQSORT)
+        kunit_skip(test, "%s is not implemented", get_sort_method_name(method));
+
+    for (n = 100000; n <= 10000000; n *= 10) {
+        int *a = kvmalloc_array(n, sizeof(int), GFP_KERNEL);
+        s64 sum = 0, us;
+        ssize_t bytes;
+        ktime_t kt;
+
+        if (!a) {
+            kunit_info(test, "no memory for %zu elements, stopping", n);
+            return;
+        }
+        fill(a, n, DIST_RANDOM, n);
+        for (i = 0; i < n; i++)
+            sum += a[i];
+
+        kt = ktime_get();
+        sort_main(a, n, sizeof(int), method, NULL, SORT_OUTPUT_ALL, &bytes);
+        us = ktime_us_delta(ktime_get(), kt);
+
+        KUNIT_EXPECT_EQ(test, bytes, (ssize_t) (n * sizeof(int)));
+        for (i = 0; i < n; i++) {
+            sum -= a[i];
+            if (i && a[i - 1] > a[i])
+                break;
+        }
+        KUNIT_EXPECT_EQ_MSG(test, i, n, "n=%zu out of order at %zu", n, i);
+        KUNIT_EXPECT_EQ(test, sum, 0);
+
+        kunit_info(test, "%s: %zu elements in %lld us, %lld elements/ms\n",
+                   get_sort_method_name(method), n, us,
+                   us ? (s64) n * 1000 / us : 0);
+        kvfree(a);
+    }
+}
+
+/* Slow cases are left out of "kunit.py run --filter speed>slow". */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+#define SORT_CASE_SLOW(test_name, gen)                          \
+    KUNIT_CASE_PARAM_ATTR(test_name, gen,                       \
+                          {.speed = KUNIT_SPEED_SLOW})
+#else
+#define SORT_CASE_SLOW(test_name, gen) KUNIT_CASE_PARAM(test_name, gen)
+#endif
+
+static struct kunit_case sort_test_cases[] = {
+    KUNIT_CASE_PARAM(sort_test_distributions, method_gen_params),
+    KUNIT_CASE_PARAM(sort_test_stability, method_gen_params),
+    KUNIT_CASE(sort_test_layout_valid),
+    SORT_CASE_SLOW(sort_test_throughput, method_gen_params),
+    {},
+};
+
+static struct kunit_suite sort_test_suite = {
+    .name = "ksort",
+    .test_cases = sort_test_cases,
+};
+
+kunit_test_suite(sort_test_suite);
@@ -1,13 +1,23 @@
 #include <linux/cdev.h>
+#include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/uaccess.h>
 #include <linux/version.h>
 
+#include "kway_merge.h"
 #include "sort.h"
+#include "sort_file.h"
+#include "sort_numa.h"
+#include "sort_stats.h"
+#include "sort_stream.h"
 #include "sort_types.h"
+#include "string_sort.h"
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("National Cheng Kung University, Taiwan");
@@ -16,6 +26,14 @@ MODULE_VERSION("0.1");
 
 #define DEVICE_NAME "sort"
 
+/* Upper bound on the number of runs a single merge request may carry. */
+#define MAX_MERGE_RUNS (1 << 16)
+
+/* Largest blob, or array of struct sort_string, a string sort copies in:
+ * the most kvmalloc() hands out.
+ */
+#define MAX_STRING_BLOB INT_MAX
+
 static dev_t dev = -1;
 static struct cdev cdev;
 static struct class *class;
@@ -24,30 +42,114 @@ static sort_method_t sort_method = TIMSORT;
 
 struct workqueue_struct *workqueue;
 
+unsigned int sort_cpu_limit;
+
+unsigned int sort_slice_us = 2000;
+module_param(sort_slice_us, uint, 0644);
+MODULE_PARM_DESC(sort_slice_us,
+                 "Longest a sort work item runs before handing off the rest, "
+                 "in microseconds (0: no limit)");
+
 static ktime_t kt;  // evaluate kernal module sorting time
 
+/* Per-open state of /dev/sort. */
+struct sort_ctx {
+    struct mutex lock;
+    struct sort_stream *stream; /* non-NULL while streaming */
+    sort_output_t output;
+    struct sort_layout layout; /* es == 0 for plain ints */
+    bool numa;                 /* sort in node-local chunks */
+};
+
 static int sort_open(struct inode *inode, struct file *file)
 {
+    struct sort_ctx *ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+    if (!ctx)
+        return -ENOMEM;
+
+    mutex_init(&ctx->lock);
+    file->private_data = ctx;
     return 0;
 }
 
 static int sort_release(struct inode *inode, struct file *file)
 {
+    struct sort_ctx *ctx = file->private_data;
+
+    if (ctx->stream)
+        sort_stream_destroy(ctx->stream);
+    mutex_destroy(&ctx->lock);
+    kfree(ctx);
     return 0;
 }
 
+/* Finish a stream: merge the sorted chunks and return them to the user. */
+static ssize_t sort_stream_finish(struct sort_ctx *ctx, char *buf, size_t size)
+{
+    ssize_t ret;
+
+    mutex_lock(&ctx->lock);
+    if (!ctx->stream) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    /* Past the size check the buffer may already be reduced for output, so
+     * only a read too small for the result may be retried.
+     */
+    ret = sort_stream_read(ctx->stream, buf, size, ctx->output, &kt);
+    if (ret != -EINVAL) {
+        sort_stream_destroy(ctx->stream);
+        ctx->stream = NULL;
+    }
+
+out:
+    mutex_unlock(&ctx->lock);
+    return ret;
+}
+
 static ssize_t sort_read(struct file *file,
                          char *buf,
                          size_t size,
                          loff_t *offset)
 {
+    struct sort_ctx *ctx = file->private_data;
+
+    if (READ_ONCE(ctx->stream))
+        return sort_stream_finish(ctx, buf, size);
+
     if (!is_valid_sort_method(sort_method))
         return 0;
 
     unsigned long len;
     size_t es;
+    ssize_t out_bytes;
+    struct sort_layout layout;
+    sort_output_t output;
+    bool numa;
+
+    mutex_lock(&ctx->lock);
+    layout = ctx->layout;
+    output = ctx->output;
+    numa = ctx->numa;
+    mutex_unlock(&ctx->lock);
+
+    /* Records are sorted by their layout; plain ints remain the default. */
+    es = layout.es ? layout.es : sizeof(int);
+    if (layout.es && (size % es || output != SORT_OUTPUT_ALL))
+        return -EINVAL;
+
+    if (numa)
+        return sort_numa(buf, size / es, es, layout.es ? &layout : NULL,
+                         output, &kt);
+
+    if (size > SORT_MAX_ALLOC)
+        return -EINVAL;
 
-    void *sort_buffer = kmalloc(size, GFP_KERNEL);
+    /* Benchmarks sweep up to 10^8 elements, far beyond what kmalloc() can
+     * hand out in one piece.
+     */
+    void *sort_buffer = kvmalloc(size, GFP_KERNEL);
     if (!sort_buffer)
         return 0;
 
@@ -55,23 +157,24 @@ static ssize_t sort_read(struct file *file,
      * operations is not ideal, even if it is only for testing purposes.
      */
     len = copy_from_user(sort_buffer, buf, size);
-    if (len != 0)
-        return 0;
-
-    /* TODO: While currently designed to handle integer arrays, there is an
-     * intention to expand the sorting object's capability to accommodate
-     * various types in the future.
-     */
-    es = sizeof(int);
+    if (len != 0) {
+        out_bytes = 0;
+        goto out;
+    }
 
-    kt = sort_main(sort_buffer, size / es, es, sort_method);
+    kt = sort_main(sort_buffer, size / es, es, sort_method,
+                   layout.es ? &layout : NULL, output, &out_bytes);
 
-    len = copy_to_user(buf, sort_buffer, size);
-    if (len != 0)
-        return 0;
+    /* Only the reduced output goes back when duplicates are folded. */
+    if (out_bytes > 0) {
+        len = copy_to_user(buf, sort_buffer, out_bytes);
+        if (len != 0)
+            out_bytes = 0;
+    }
 
-    kfree(sort_buffer);
-    return size;
+out:
+    kvfree(sort_buffer);
+    return out_bytes;
 }
 
 static ssize_t sort_write(struct file *file,
@@ -79,7 +182,19 @@ static ssize_t sort_write(struct file *file,
                           size_t size,
                           loff_t *offset)
 {
+    struct sort_ctx *ctx = file->private_data;
     int method;
+
+    if (READ_ONCE(ctx->stream)) {
+        ssize_t ret;
+
+        mutex_lock(&ctx->lock);
+        ret = ctx->stream ? sort_stream_write(ctx->stream, buf, size)
+                          : -EINVAL;
+        mutex_unlock(&ctx->lock);
+        return ret;
+    }
+
     if (size != sizeof(method)) {
         printk(KERN_INFO "Expected %lu bytes but got %lu bytes\n",
                sizeof(method), size);
@@ -102,16 +217,282 @@ static ssize_t sort_write(struct file *file,
     return sizeof(method);
 }
 
-static long sort_time(struct file *file, unsigned int cmd, unsigned long arg)
+static long sort_merge(void __user *arg)
+{
+    struct sort_merge_req req;
+    const u64 __user *ubounds;
+    size_t *bounds, n, size;
+    void *merge_buffer;
+    long ret;
+    u32 i;
+
+    if (copy_from_user(&req, arg, sizeof(req)))
+        return -EFAULT;
+
+    if (req.reserved || !req.nr_runs || req.nr_runs > MAX_MERGE_RUNS)
+        return -EINVAL;
+
+    bounds = kmalloc_array(req.nr_runs + 1, sizeof(*bounds), GFP_KERNEL);
+    if (!bounds)
+        return -ENOMEM;
+
+    ubounds = u64_to_user_ptr(req.bounds);
+    for (i = 0; i <= req.nr_runs; i++) {
+        u64 b;
+
+        if (get_user(b, &ubounds[i])) {
+            ret = -EFAULT;
+            goto out_free_bounds;
+        }
+        if ((i == 0 && b != 0) || (i > 0 && b < bounds[i - 1]) ||
+            b > SORT_MAX_ALLOC / sizeof(int)) {
+            ret = -EINVAL;
+            goto out_free_bounds;
+        }
+        bounds[i] = b;
+    }
+
+    n = bounds[req.nr_runs];
+    size = n * sizeof(int);
+    merge_buffer = kvmalloc(size, GFP_KERNEL);
+    if (!merge_buffer) {
+        ret = -ENOMEM;
+        goto out_free_bounds;
+    }
+
+    if (copy_from_user(merge_buffer, u64_to_user_ptr(req.buf), size)) {
+        ret = -EFAULT;
+        goto out_free_buffer;
+    }
+
+    kt = ktime_get();
+    ret = kway_merge(merge_buffer, sizeof(int), bounds, req.nr_runs, num_cmp,
+                     NULL);
+    kt = ktime_sub(ktime_get(), kt);
+    if (ret)
+        goto out_free_buffer;
+
+    if (copy_to_user(u64_to_user_ptr(req.buf), merge_buffer, size))
+        ret = -EFAULT;
+
+out_free_buffer:
+    kvfree(merge_buffer);
+out_free_bounds:
+    kfree(bounds);
+    return ret;
+}
+
+static long sort_strings(void __user *arg)
+{
+    struct sort_strings_req req;
+    struct sort_string *strings;
+    size_t size;
+    u8 *blob;
+    long ret;
+    u32 i;
+
+    if (copy_from_user(&req, arg, sizeof(req)))
+        return -EFAULT;
+
+    if (req.reserved || req.blob_len > MAX_STRING_BLOB)
+        return -EINVAL;
+
+    size = (size_t) req.nr_strings * sizeof(*strings);
+    if (size > MAX_STRING_BLOB)
+        return -EINVAL;
+    strings = kvmalloc(size, GFP_KERNEL);
+    if (!strings)
+        return -ENOMEM;
+
+    if (copy_from_user(strings, u64_to_user_ptr(req.strings), size)) {
+        ret = -EFAULT;
+        goto out_free_strings;
+    }
+    for (i = 0; i < req.nr_strings; i++) {
+        if (strings[i].reserved || strings[i].offset > req.blob_len ||
+            strings[i].len > req.blob_len - strings[i].offset) {
+            ret = -EINVAL;
+            goto out_free_strings;
+        }
+    }
+
+    blob = kvmalloc(req.blob_len, GFP_KERNEL);
+    if (!blob) {
+        ret = -ENOMEM;
+        goto out_free_strings;
+    }
+
+    if (copy_from_user(blob, u64_to_user_ptr(req.blob), req.blob_len)) {
+        ret = -EFAULT;
+        goto out_free_blob;
+    }
+
+    kt = ktime_get();
+    ret = string_sort(blob, strings, req.nr_strings);
+    kt = ktime_sub(ktime_get(), kt);
+    if (ret)
+        goto out_free_blob;
+
+    if (copy_to_user(u64_to_user_ptr(req.strings), strings, size))
+        ret = -EFAULT;
+
+out_free_blob:
+    kvfree(blob);
+out_free_strings:
+    kvfree(strings);
+    return ret;
+}
+
+static long sort_file_ioctl(struct sort_ctx *ctx, void __user *arg)
 {
-    return (long) ktime_to_ns(kt);
+    struct sort_file_req req;
+    struct sort_layout layout;
+    struct file *file, *tmp = NULL;
+    long ret;
+
+    if (copy_from_user(&req, arg, sizeof(req)))
+        return -EFAULT;
+
+    mutex_lock(&ctx->lock);
+    layout = ctx->layout;
+    mutex_unlock(&ctx->lock);
+
+    file = fget(req.fd);
+    if (!file)
+        return -EBADF;
+    if (req.tmp_fd >= 0) {
+        tmp = fget(req.tmp_fd);
+        if (!tmp) {
+            ret = -EBADF;
+            goto out;
+        }
+    }
+
+    ret = sort_file(file, tmp, layout.es ? layout.es : sizeof(int),
+                    layout.es ? &layout : NULL, sort_method,
+                    min_t(u64, req.mem_limit, SIZE_MAX), &kt);
+
+    if (tmp)
+        fput(tmp);
+out:
+    fput(file);
+    return ret;
+}
+
+static long sort_stream_start(struct sort_ctx *ctx, size_t capacity)
+{
+    struct sort_stream *stream;
+    long ret = 0;
+
+    mutex_lock(&ctx->lock);
+    if (ctx->stream) {
+        ret = -EBUSY;
+        goto out;
+    }
+
+    stream = sort_stream_create(capacity);
+    if (IS_ERR(stream)) {
+        ret = PTR_ERR(stream);
+        goto out;
+    }
+    ctx->stream = stream;
+
+out:
+    mutex_unlock(&ctx->lock);
+    return ret;
+}
+
+static long sort_set_output(struct sort_ctx *ctx, unsigned long output)
+{
+    if (!is_valid_sort_output(output))
+        return -EINVAL;
+
+    mutex_lock(&ctx->lock);
+    ctx->output = output;
+    mutex_unlock(&ctx->lock);
+    return 0;
+}
+
+static long sort_set_layout(struct sort_ctx *ctx, void __user *arg)
+{
+    struct sort_layout layout;
+
+    if (copy_from_user(&layout, arg, sizeof(layout)))
+        return -EFAULT;
+
+    if (layout.es && !is_valid_sort_layout(&layout))
+        return -EINVAL;
+
+    mutex_lock(&ctx->lock);
+    ctx->layout = layout;
+    mutex_unlock(&ctx->lock);
+    return 0;
+}
+
+static long sort_set_numa(struct sort_ctx *ctx, unsigned long numa)
+{
+    mutex_lock(&ctx->lock);
+    ctx->numa = !!numa;
+    mutex_unlock(&ctx->lock);
+    return 0;
+}
+
+static long sort_set_cpus(unsigned long limit)
+{
+    if (limit > nr_cpu_ids)
+        return -EINVAL;
+
+    WRITE_ONCE(sort_cpu_limit, limit);
+    return 0;
+}
+
+static long sort_get_stats(void __user *arg)
+{
+    struct sort_stats *stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+    long ret = 0;
+
+    if (!stats)
+        return -ENOMEM;
+
+    sort_stats_fetch(stats);
+    if (copy_to_user(arg, stats, sizeof(*stats)))
+        ret = -EFAULT;
+
+    kfree(stats);
+    return ret;
+}
+
+static long sort_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    switch (cmd) {
+    case SORT_IOC_MERGE:
+        return sort_merge((void __user *) arg);
+    case SORT_IOC_STREAM:
+        return sort_stream_start(file->private_data, arg);
+    case SORT_IOC_OUTPUT:
+        return sort_set_output(file->private_data, arg);
+    case SORT_IOC_LAYOUT:
+        return sort_set_layout(file->private_data, (void __user *) arg);
+    case SORT_IOC_CPUS:
+        return sort_set_cpus(arg);
+    case SORT_IOC_STATS:
+        return sort_get_stats((void __user *) arg);
+    case SORT_IOC_NUMA:
+        return sort_set_numa(file->private_data, arg);
+    case SORT_IOC_STRINGS:
+        return sort_strings((void __user *) arg);
+    case SORT_IOC_FILE:
+        return sort_file_ioctl(file->private_data, (void __user *) arg);
+    default:
+        return (long) ktime_to_ns(kt);
+    }
 }
 static const struct file_operations fops = {
     .read = sort_read,
     .write = sort_write,
     .open = sort_open,
     .release = sort_release,
-    .unlocked_ioctl = sort_time,
+    .unlocked_ioctl = sort_ioctl,
     .owner = THIS_MODULE,
 };
 
@@ -0,0 +1,121 @@
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/time.h>
+#include <linux/topology.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+
+#include "kway_merge.h"
+#include "sort.h"
+#include "sort_numa.h"
+#include "sort_stats.h"
+
+/* Chunks smaller than this are not worth their own allocation and worker. */
+#define NUMA_MIN_CHUNK 16384
+
+struct numa_chunk {
+    struct work_struct w;
+    char *a;
+    size_t n;
+    int cpu;
+    size_t es;
+    cmp_t *cmp;
+    const void *priv;
+};
+
+static void numa_chunk_func(struct work_struct *w)
+{
+    struct numa_chunk *c = container_of(w, struct numa_chunk, w);
+    ktime_t start = ktime_get();
+
+    sort_r_resched(c->a, c->n, c->es, c->cmp, c->priv);
+    sort_stats_account(start);
+}
+
+ssize_t sort_numa(char __user *buf,
+                  size_t n,
+                  size_t es,
+                  const struct sort_layout *layout,
+                  sort_output_t output,
+                  ktime_t *kt)
+{
+    cmp_t *cmp = layout ? layout_cmp : num_cmp;
+    size_t nr_chunks, i;
+    struct numa_chunk *chunks;
+    char **start, *out;
+    ssize_t ret;
+    int cpu = -1;
+
+    *kt = 0;
+    if (!n)
+        return 0;
+    /* The output takes all n elements in one kvmalloc(), and no chunk more. */
+    if (n > SORT_MAX_ALLOC / es)
+        return -EINVAL;
+
+    nr_chunks = clamp_t(size_t, n / NUMA_MIN_CHUNK, 1, nr_sort_cpus());
+    chunks = kcalloc(nr_chunks, sizeof(*chunks), GFP_KERNEL);
+    start = kmalloc_array(2 * nr_chunks, sizeof(*start), GFP_KERNEL);
+    out = kvmalloc_array(n, es, GFP_KERNEL);
+    if (!chunks || !start || !out) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    /* The pages of a chunk come from its node when it is allocated, so
+     * copying the input in from here already places it.
+     */
+    for (i = 0; i < nr_chunks; i++) {
+        struct numa_chunk *c = &chunks[i];
+        size_t lo = n * i / nr_chunks, hi = n * (i + 1) / nr_chunks;
+
+        cpu = next_online_cpu(cpu);
+        c->cpu = cpu;
+        c->n = hi - lo;
+        c->es = es;
+        c->cmp = cmp;
+        c->priv = layout;
+        c->a = kvmalloc_node(c->n * es, GFP_KERNEL, cpu_to_node(cpu));
+        if (!c->a) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        if (copy_from_user(c->a, buf + lo * es, c->n * es)) {
+            ret = -EFAULT;
+            goto out;
+        }
+        start[i] = c->a;
+        start[nr_chunks + i] = c->a + c->n * es;
+    }
+
+    *kt = ktime_get();
+    for (i = 0; i < nr_chunks; i++) {
+        INIT_WORK(&chunks[i].w, numa_chunk_func);
+        queue_work_on(chunks[i].cpu, workqueue, &chunks[i].w);
+    }
+    for (i = 0; i < nr_chunks; i++)
+        flush_work(&chunks[i].w);
+
+    /* The merge reads every chunk once and writes the result on this
+     * node, from which it is copied out.
+     */
+    ret = kway_merge_runs(out, start, start + nr_chunks, nr_chunks, es, cmp,
+                          layout);
+    *kt = ktime_sub(ktime_get(), *kt);
+    if (ret)
+        goto out;
+
+    ret = layout ? n * es : sort_output(out, n, output);
+    if (ret > 0 && copy_to_user(buf, out, ret))
+        ret = -EFAULT;
+
+out:
+    if (chunks) {
+        for (i = 0; i < nr_chunks; i++)
+            kvfree(chunks[i].a);
+    }
+    kvfree(out);
+    kfree(start);
+    kfree(chunks);
+    return ret;
+}
@@ -0,0 +1,22 @@
+#ifndef SORT_NUMA_H
+#define SORT_NUMA_H
+
+#include <linux/types.h>
+
+#include "sort_types.h"
+
+/* Sort n elements of es bytes straight from the user buffer buf and write
+ * the output back to it. Each CPU the engines may use gets one chunk of
+ * the input, allocated on its own node and sorted there by a worker bound
+ * to that CPU. A single merge across the nodes then writes the result.
+ * A NULL layout means plain ints, as for sort_main(). Returns the number of
+ * bytes written back or a negative errno; *kt receives the sorting time.
+ */
+ssize_t sort_numa(char __user *buf,
+                  size_t n,
+                  size_t es,
+                  const struct sort_layout *layout,
+                  sort_output_t output,
+                  ktime_t *kt);
+
+#endif  // SORT_NUMA_H
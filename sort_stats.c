@@ -0,0 +1,32 @@
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/smp.h>
+#include <linux/string.h>
+
+#include "sort_stats.h"
+
+/* Work items are coarse, so shared atomics cost little next to them. */
+static atomic64_t work_items;
+static atomic64_t busy_ns[SORT_STATS_MAX_CPUS];
+
+void sort_stats_account(ktime_t start)
+{
+    unsigned int cpu = raw_smp_processor_id();
+
+    atomic64_inc(&work_items);
+    if (cpu < SORT_STATS_MAX_CPUS)
+        atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+                     &busy_ns[cpu]);
+}
+
+void sort_stats_fetch(struct sort_stats *stats)
+{
+    unsigned int cpu;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->nr_cpus = min_t(unsigned int, nr_cpu_ids, SORT_STATS_MAX_CPUS);
+    stats->work_items = atomic64_xchg(&work_items, 0);
+    for (cpu = 0; cpu < stats->nr_cpus; cpu++)
+        stats->busy_ns[cpu] = atomic64_xchg(&busy_ns[cpu], 0);
+}
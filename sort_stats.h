@@ -0,0 +1,16 @@
+#ifndef SORT_STATS_H
+#define SORT_STATS_H
+
+#include <linux/time.h>
+
+#include "sort_types.h"
+
+/* Account a work item that started at start and just finished on this
+ * CPU. Work functions call it last.
+ */
+void sort_stats_account(ktime_t start);
+
+/* Fill stats with the totals since the last call and reset them. */
+void sort_stats_fetch(struct sort_stats *stats);
+
+#endif  // SORT_STATS_H
@@ -0,0 +1,162 @@
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/time.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+
+#include "kway_merge.h"
+#include "sort.h"
+#include "sort_stats.h"
+#include "sort_stream.h"
+
+/* Number of buffered elements that makes up a chunk worth sorting. */
+#define STREAM_CHUNK 16384
+
+struct stream_chunk {
+    struct work_struct w;
+    int *a;
+    size_t n;
+};
+
+struct sort_stream {
+    int *buffer;
+    size_t capacity;  /* elements the buffer can hold */
+    size_t filled;    /* elements copied in so far */
+    size_t nr_chunks; /* chunks queued for sorting */
+    size_t *bounds;   /* nr_chunks + 1 chunk boundaries */
+    struct stream_chunk *chunks;
+    int cpu;
+};
+
+static void stream_chunk_func(struct work_struct *w)
+{
+    struct stream_chunk *c = container_of(w, struct stream_chunk, w);
+    ktime_t start = ktime_get();
+
+    sort_r_resched(c->a, c->n, sizeof(int), num_cmp, NULL);
+    sort_stats_account(start);
+}
+
+/* Hand the elements buffered since the last chunk to the workqueue. */
+static void stream_queue_chunk(struct sort_stream *stream)
+{
+    size_t start = stream->bounds[stream->nr_chunks];
+    struct stream_chunk *c = &stream->chunks[stream->nr_chunks];
+
+    INIT_WORK(&c->w, stream_chunk_func);
+    c->a = stream->buffer + start;
+    c->n = stream->filled - start;
+
+    stream->bounds[++stream->nr_chunks] = stream->filled;
+    stream->cpu = next_online_cpu(stream->cpu);
+    queue_work_on(stream->cpu, workqueue, &c->w);
+}
+
+static void stream_flush(struct sort_stream *stream)
+{
+    size_t i;
+
+    for (i = 0; i < stream->nr_chunks; i++)
+        flush_work(&stream->chunks[i].w);
+}
+
+struct sort_stream *sort_stream_create(size_t capacity)
+{
+    struct sort_stream *stream;
+    size_t max_chunks;
+
+    /* The buffer comes from kvmalloc() in one piece. */
+    if (capacity > SORT_MAX_ALLOC)
+        return ERR_PTR(-EINVAL);
+    capacity /= sizeof(int);
+    if (!capacity)
+        return ERR_PTR(-EINVAL);
+
+    stream = kzalloc(sizeof(*stream), GFP_KERNEL);
+    if (!stream)
+        return ERR_PTR(-ENOMEM);
+
+    /* Every write but the last seals at most one chunk of at least
+     * STREAM_CHUNK elements, and the read seals the remainder.
+     */
+    max_chunks = capacity / STREAM_CHUNK + 1;
+    stream->capacity = capacity;
+    stream->cpu = -1;
+    stream->buffer = kvmalloc_array(capacity, sizeof(int), GFP_KERNEL);
+    stream->bounds =
+        kvmalloc_array(max_chunks + 1, sizeof(*stream->bounds), GFP_KERNEL);
+    stream->chunks =
+        kvmalloc_array(max_chunks, sizeof(*stream->chunks), GFP_KERNEL);
+    if (!stream->buffer || !stream->bounds || !stream->chunks) {
+        sort_stream_destroy(stream);
+        return ERR_PTR(-ENOMEM);
+    }
+    stream->bounds[0] = 0;
+
+    return stream;
+}
+
+ssize_t sort_stream_write(struct sort_stream *stream,
+                          const char __user *buf,
+                          size_t size)
+{
+    size_t n = size / sizeof(int);
+
+    if (size % sizeof(int))
+        return -EINVAL;
+    if (n > stream->capacity - stream->filled)
+        return -ENOSPC;
+
+    if (copy_from_user(stream->buffer + stream->filled, buf, size))
+        return -EFAULT;
+    stream->filled += n;
+
+    if (stream->filled - stream->bounds[stream->nr_chunks] >= STREAM_CHUNK)
+        stream_queue_chunk(stream);
+
+    return size;
+}
+
+ssize_t sort_stream_read(struct sort_stream *stream,
+                         char __user *buf,
+                         size_t size,
+                         sort_output_t output,
+                         ktime_t *kt)
+{
+    ssize_t bytes;
+    int ret;
+
+    if (size < stream->filled * sizeof(int))
+        return -EINVAL;
+
+    *kt = ktime_get();
+    if (stream->filled > stream->bounds[stream->nr_chunks])
+        stream_queue_chunk(stream);
+    stream_flush(stream);
+
+    ret = kway_merge(stream->buffer, sizeof(int), stream->bounds,
+                     stream->nr_chunks, num_cmp, NULL);
+    *kt = ktime_sub(ktime_get(), *kt);
+    if (ret)
+        return ret;
+
+    bytes = sort_output(stream->buffer, stream->filled, output);
+    if (bytes < 0)
+        return bytes;
+
+    if (copy_to_user(buf, stream->buffer, bytes))
+        return -EFAULT;
+
+    return bytes;
+}
+
+void sort_stream_destroy(struct sort_stream *stream)
+{
+    if (stream->chunks)
+        stream_flush(stream);
+
+    kvfree(stream->chunks);
+    kvfree(stream->bounds);
+    kvfree(stream->buffer);
+    kfree(stream);
+}
@@ -0,0 +1,33 @@
+#ifndef SORT_STREAM_H
+#define SORT_STREAM_H
+
+#include <linux/types.h>
+
+#include "sort_types.h"
+
+/* A stream collects ints from successive write() calls. Every completed
+ * chunk is sorted on the workqueue while later chunks are still being
+ * copied in, and sort_stream_read() merges the sorted chunks.
+ */
+struct sort_stream;
+
+struct sort_stream *sort_stream_create(size_t capacity);
+
+ssize_t sort_stream_write(struct sort_stream *stream,
+                          const char __user *buf,
+                          size_t size);
+
+/* Merge the chunks, reduce them as output requests, in place, and copy the
+ * result to buf. Returns its length, or -EINVAL with the stream untouched
+ * when size cannot hold every element. After any other error the stream
+ * holds no usable data and must be destroyed.
+ */
+ssize_t sort_stream_read(struct sort_stream *stream,
+                         char __user *buf,
+                         size_t size,
+                         sort_output_t output,
+                         ktime_t *kt);
+
+void sort_stream_destroy(struct sort_stream *stream);
+
+#endif  // SORT_STREAM_H
@@ -11,6 +11,10 @@ const char *get_sort_method_name(sort_method_t method)
         return "Pattern-defeating Quick Sort";
     case LINUX_SORT:
         return "Library Sort";
+    case INPLACE_SORT:
+        return "In-place Merge Sort";
+    case COUNT_SORT:
+        return "Counting Sort";
     default:
         return "Unknown Method";
     }
@@ -1,13 +1,182 @@
 #ifndef SORT_TYPES_H
 #define SORT_TYPES_H
 
-typedef enum { QSORT, TIMSORT, PDQSORT, LINUX_SORT } sort_method_t;
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+typedef enum {
+    QSORT,
+    TIMSORT,
+    PDQSORT,
+    LINUX_SORT,
+    INPLACE_SORT,
+    COUNT_SORT
+} sort_method_t;
 
 extern const char *get_sort_method_name(sort_method_t method);
 
 static inline int is_valid_sort_method(int method)
 {
-    return method >= QSORT && method <= LINUX_SORT;
+    return method >= QSORT && method <= COUNT_SORT;
+}
+
+/* What a read() returns: every key, each distinct key once, or one
+ * struct sort_key_count per distinct key.
+ */
+typedef enum {
+    SORT_OUTPUT_ALL,
+    SORT_OUTPUT_UNIQUE,
+    SORT_OUTPUT_COUNT
+} sort_output_t;
+
+static inline int is_valid_sort_output(unsigned long output)
+{
+    return output <= SORT_OUTPUT_COUNT;
+}
+
+struct sort_key_count {
+    __s32 key;
+    __u32 count;
+};
+
+#define SORT_MAX_KEYS 4
+#define SORT_MAX_RECORD 4096
+
+/* One key of a record: width bytes at offset, in native byte order. */
+struct sort_key {
+    __u32 offset;
+    __u8 width; /* 1, 2, 4 or 8 */
+    __u8 is_signed;
+    __u8 descend;
+    __u8 reserved;
+};
+
+/* Records of es bytes ordered by keys[0], ties broken by the next keys. */
+struct sort_layout {
+    __u32 es;
+    __u32 nr_keys;
+    struct sort_key keys[SORT_MAX_KEYS];
+};
+
+static inline int is_valid_sort_layout(const struct sort_layout *layout)
+{
+    __u32 i;
+
+    if (!layout->es || layout->es > SORT_MAX_RECORD || !layout->nr_keys ||
+        layout->nr_keys > SORT_MAX_KEYS)
+        return 0;
+
+    for (i = 0; i < layout->nr_keys; i++) {
+        const struct sort_key *key = &layout->keys[i];
+
+        if (key->width != 1 && key->width != 2 && key->width != 4 &&
+            key->width != 8)
+            return 0;
+        /* Checked first, as es - width would wrap around. */
+        if (key->width > layout->es || key->offset > layout->es - key->width)
+            return 0;
+    }
+    return 1;
 }
 
+/* Merge nr_runs sorted runs of ints held in buf. bounds points to
+ * nr_runs + 1 element offsets starting at 0, so run i covers the elements
+ * [bounds[i], bounds[i + 1]). The merged result replaces the buffer.
+ */
+struct sort_merge_req {
+    __u64 buf;
+    __u64 bounds;
+    __u32 nr_runs;
+    __u32 reserved;
+};
+
+#define SORT_IOC_MAGIC 'k'
+
+/* The original interface: any other command returns the last sort time. */
+#define SORT_IOC_TIME 0
+#define SORT_IOC_MERGE _IOW(SORT_IOC_MAGIC, 1, struct sort_merge_req)
+
+/* Start streaming up to arg bytes of ints. Every following write() appends
+ * a chunk, which is sorted while the next ones are copied in, and the
+ * next read() returns the merged result and ends the stream.
+ */
+#define SORT_IOC_STREAM _IO(SORT_IOC_MAGIC, 2)
+
+/* Select the sort_output_t of the following reads on this file. A read
+ * fails with EOVERFLOW if the (key, count) pairs do not fit its buffer.
+ */
+#define SORT_IOC_OUTPUT _IO(SORT_IOC_MAGIC, 3)
+
+/* Make the following reads on this file sort records described by a
+ * struct sort_layout. A layout with es == 0 goes back to plain ints.
+ * Records only support SORT_OUTPUT_ALL.
+ */
+#define SORT_IOC_LAYOUT _IOW(SORT_IOC_MAGIC, 4, struct sort_layout)
+
+/* Queue sort work only on the CPUs numbered below arg; 0 lifts the limit.
+ * Unlike the settings above, the limit applies to every open file.
+ */
+#define SORT_IOC_CPUS _IO(SORT_IOC_MAGIC, 5)
+
+#define SORT_STATS_MAX_CPUS 256
+
+/* Work done by the sort engines of the module since the last read. */
+struct sort_stats {
+    __u64 work_items;
+    __u32 nr_cpus; /* entries of busy_ns in use */
+    __u32 reserved;
+    __u64 busy_ns[SORT_STATS_MAX_CPUS]; /* time spent in work items */
+};
+
+/* Copy out the stats and reset them. */
+#define SORT_IOC_STATS _IOR(SORT_IOC_MAGIC, 6, struct sort_stats)
+
+/* With a non-zero arg, the following reads on this file split the input
+ * into one chunk per allowed CPU, placed on the NUMA node of that CPU and
+ * sorted there with sort_r(), whatever the sort method. One merge across
+ * the nodes then produces the result. 0 goes back to the sort method.
+ */
+#define SORT_IOC_NUMA _IO(SORT_IOC_MAGIC, 7)
+
+/* One string of a SORT_IOC_STRINGS request: len bytes at offset in the
+ * blob. reserved must be 0 and is 0 on return.
+ */
+struct sort_string {
+    __u64 offset;
+    __u32 len;
+    __u32 reserved;
+};
+
+/* Sort nr_strings byte strings held in blob. Strings compare like memcmp()
+ * over their common length, with a prefix before any longer string. The
+ * struct sort_string array at strings is rewritten in sorted order; equal
+ * strings end up in no particular order. The blob is left untouched.
+ */
+struct sort_strings_req {
+    __u64 blob;
+    __u64 blob_len;
+    __u64 strings;
+    __u32 nr_strings;
+    __u32 reserved;
+};
+
+#define SORT_IOC_STRINGS _IOWR(SORT_IOC_MAGIC, 8, struct sort_strings_req)
+
+/* Sort the regular file fd in place: plain ints, or records of the layout
+ * set with SORT_IOC_LAYOUT, by the current sort method. Up to mem_limit
+ * bytes of it (0 for 64 MiB) are sorted in memory. A larger file is cut
+ * into sorted runs written to tmp_fd, at the same offsets, which are then
+ * merged back into fd. tmp_fd may be -1 for files that fit, and should
+ * otherwise be another regular file, such as one opened with O_TMPFILE.
+ * Both files must be open for reading and writing. The output mode does
+ * not apply.
+ */
+struct sort_file_req {
+    __s32 fd;
+    __s32 tmp_fd;
+    __u64 mem_limit;
+};
+
+#define SORT_IOC_FILE _IOW(SORT_IOC_MAGIC, 9, struct sort_file_req)
+
 #endif  // SORT_TYPES_H
\ No newline at end of file
@@ -0,0 +1,287 @@
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/time.h>
+#include <linux/workqueue.h>
+
+#include "sort.h"
+#include "sort_stats.h"
+#include "string_sort.h"
+
+/* Bytes of a string cached in every element. */
+#define STR_KEY_BYTES 8
+
+/* Partitions at least this long are sorted by a work item of their own. */
+#define STR_MIN_PART 4096
+
+/* Partitions shorter than this go to insertion sort. */
+#define STR_INSERTION 16
+
+/* A string and its STR_KEY_BYTES bytes from the current depth, big-endian
+ * and zero padded, so comparing keys compares the bytes. avail tells a
+ * string that ends within the key from one padded with zero bytes.
+ */
+struct str_item {
+    u64 key;
+    const u8 *s;
+    u32 len;
+    u32 avail;
+};
+
+/* The strings a[0, n), which agree on their first depth bytes. */
+struct str_range {
+    struct str_item *a;
+    size_t n, depth;
+};
+
+struct str_sort {
+    int cpu; /* Last CPU a work item was queued on */
+
+    /* Work items in flight, plus one held by string_sort(). */
+    atomic_t pending;
+    struct completion done;
+};
+
+struct str_work {
+    struct work_struct w;
+    struct str_sort *ss;
+    struct str_item *a;
+    size_t n, depth;
+};
+
+static void str_load(struct str_item *it, size_t depth)
+{
+    size_t i;
+
+    it->avail = it->len > depth ? min_t(size_t, it->len - depth,
+                                        STR_KEY_BYTES)
+                                : 0;
+    it->key = 0;
+    for (i = 0; i < it->avail; i++)
+        it->key |= (u64) it->s[depth + i] << (8 * (STR_KEY_BYTES - 1 - i));
+}
+
+static inline int key_cmp(const struct str_item *a, const struct str_item *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    return (a->avail > b->avail) - (a->avail < b->avail);
+}
+
+/* Compare two strings that agree on their first depth bytes. */
+static int str_cmp(const struct str_item *a,
+                   const struct str_item *b,
+                   size_t depth)
+{
+    size_t la, lb;
+    int r = key_cmp(a, b);
+
+    if (r || a->avail < STR_KEY_BYTES)
+        return r;
+
+    depth += STR_KEY_BYTES;
+    la = a->len - depth;
+    lb = b->len - depth;
+    r = memcmp(a->s + depth, b->s + depth, min(la, lb));
+    if (r)
+        return r;
+    return (la > lb) - (la < lb);
+}
+
+static struct str_item *str_med3(struct str_item *a,
+                                 struct str_item *b,
+                                 struct str_item *c)
+{
+    return key_cmp(a, b) < 0
+               ? (key_cmp(b, c) < 0 ? b : (key_cmp(a, c) < 0 ? c : a))
+               : (key_cmp(b, c) > 0 ? b : (key_cmp(a, c) < 0 ? a : c));
+}
+
+static void str_queue(struct str_sort *ss,
+                      struct str_item *a,
+                      size_t n,
+                      size_t depth);
+
+static void str_mkqs(struct str_sort *ss,
+                     struct str_item *a,
+                     size_t n,
+                     size_t depth,
+                     unsigned int *work);
+
+static void str_part(struct str_sort *ss,
+                     struct str_item *a,
+                     size_t n,
+                     size_t depth,
+                     unsigned int *work)
+{
+    if (n >= STR_MIN_PART)
+        str_queue(ss, a, n, depth);
+    else if (n > 1)
+        str_mkqs(ss, a, n, depth, work);
+}
+
+/* Multikey quicksort after Bentley and Sedgewick, "Fast Algorithms for
+ * Sorting and Searching Strings", one key of STR_KEY_BYTES at a time.
+ * Every element of a agrees on its first depth bytes. Of the three
+ * partitions, only the largest is sorted by the loop; the others hold at
+ * most half of the elements each, which keeps the recursion O(log n) deep.
+ */
+static void str_mkqs(struct str_sort *ss,
+                     struct str_item *a,
+                     size_t n,
+                     size_t depth,
+                     unsigned int *work)
+{
+    struct str_item p;
+    size_t lt, i, gt, j, big;
+
+    while (n >= STR_INSERTION) {
+        size_t d = n / 8;
+
+        p = *str_med3(str_med3(&a[0], &a[d], &a[2 * d]),
+                      str_med3(&a[n / 2 - d], &a[n / 2], &a[n / 2 + d]),
+                      str_med3(&a[n - 1 - 2 * d], &a[n - 1 - d], &a[n - 1]));
+
+        /* [0, lt) < p, [lt, i) == p, [gt, n) > p */
+        lt = i = 0;
+        gt = n;
+        while (i < gt) {
+            int r = key_cmp(&a[i], &p);
+
+            sort_resched(work);
+            if (r < 0) {
+                swap(a[lt], a[i]);
+                lt++;
+                i++;
+            } else if (r > 0) {
+                gt--;
+                swap(a[i], a[gt]);
+            } else {
+                i++;
+            }
+        }
+
+        struct str_range r[3] = {
+            {a, lt, depth},
+            {a + gt, n - gt, depth},
+            {a + lt, 0, depth + STR_KEY_BYTES},
+        };
+
+        /* Strings that end within the pivot key are all equal. */
+        if (p.avail == STR_KEY_BYTES) {
+            r[2].n = gt - lt;
+            for (i = 0; i < r[2].n; i++) {
+                sort_resched(work);
+                str_load(&r[2].a[i], r[2].depth);
+            }
+        }
+
+        big = 0;
+        for (i = 1; i < ARRAY_SIZE(r); i++) {
+            if (r[i].n > r[big].n)
+                big = i;
+        }
+        for (i = 0; i < ARRAY_SIZE(r); i++) {
+            if (i != big)
+                str_part(ss, r[i].a, r[i].n, r[i].depth, work);
+        }
+        a = r[big].a;
+        n = r[big].n;
+        depth = r[big].depth;
+    }
+
+    for (i = 1; i < n; i++) {
+        for (j = i; j > 0 && str_cmp(&a[j], &a[j - 1], depth) < 0; j--) {
+            sort_resched(work);
+            swap(a[j], a[j - 1]);
+        }
+    }
+}
+
+/* The completion is the last thing touched, as the waiter owns ss. */
+static void str_put(struct str_sort *ss)
+{
+    if (atomic_dec_and_test(&ss->pending))
+        complete(&ss->done);
+}
+
+/* Every struct str_work is queued once and freed by its own work function. */
+static void str_func(struct work_struct *w)
+{
+    struct str_work *sw = container_of(w, struct str_work, w);
+    struct str_sort *ss = sw->ss;
+    ktime_t start = ktime_get();
+    unsigned int work = 0;
+
+    str_mkqs(ss, sw->a, sw->n, sw->depth, &work);
+    kfree(sw);
+    sort_stats_account(start);
+    str_put(ss);
+}
+
+/* Sort a on another CPU, or right here if out of memory. Workers racing on
+ * ss->cpu may pick the same CPU, which only costs balance.
+ */
+static void str_queue(struct str_sort *ss,
+                      struct str_item *a,
+                      size_t n,
+                      size_t depth)
+{
+    struct str_work *sw = kmalloc(sizeof(*sw), GFP_KERNEL);
+    unsigned int work = 0;
+    int cpu;
+
+    if (!sw) {
+        str_mkqs(ss, a, n, depth, &work);
+        return;
+    }
+    INIT_WORK(&sw->w, str_func);
+    sw->ss = ss;
+    sw->a = a;
+    sw->n = n;
+    sw->depth = depth;
+
+    atomic_inc(&ss->pending);
+    cpu = next_online_cpu(READ_ONCE(ss->cpu));
+    WRITE_ONCE(ss->cpu, cpu);
+    queue_work_on(cpu, workqueue, &sw->w);
+}
+
+int string_sort(const u8 *blob, struct sort_string *strings, size_t n)
+{
+    struct str_sort ss = {.cpu = -1};
+    struct str_item *items;
+    unsigned int work = 0;
+    size_t i;
+
+    if (n <= 1)
+        return 0;
+
+    items = kvmalloc_array(n, sizeof(*items), GFP_KERNEL);
+    if (!items)
+        return -ENOMEM;
+
+    for (i = 0; i < n; i++) {
+        sort_resched(&work);
+        items[i].s = blob + strings[i].offset;
+        items[i].len = strings[i].len;
+        str_load(&items[i], 0);
+    }
+
+    atomic_set(&ss.pending, 1);
+    init_completion(&ss.done);
+    str_queue(&ss, items, n, 0);
+    str_put(&ss);
+    wait_for_completion(&ss.done);
+
+    for (i = 0; i < n; i++) {
+        sort_resched(&work);
+        strings[i].offset = items[i].s - blob;
+        strings[i].len = items[i].len;
+        strings[i].reserved = 0;
+    }
+
+    kvfree(items);
+    return 0;
+}
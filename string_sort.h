@@ -0,0 +1,17 @@
+#ifndef STRING_SORT_H
+#define STRING_SORT_H
+
+#include <linux/types.h>
+
+#include "sort_types.h"
+
+/* Reorder the n strings of blob described by strings[] as SORT_IOC_STRINGS
+ * defines, with a multikey quicksort. Every element caches the 8 bytes of
+ * its string at the current depth, so partitioning compares one word and a
+ * common prefix is only looked at once per element. Large partitions are
+ * sorted on the workqueue. Every string must lie within blob. Returns 0 or
+ * -ENOMEM, leaving strings[] untouched in that case. Sleeps.
+ */
+int string_sort(const u8 *blob, struct sort_string *strings, size_t n);
+
+#endif  // STRING_SORT_H
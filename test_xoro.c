@@ -3,11 +3,32 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
-#define MAX_BYTES_PER_READ 8
+#include "xoro_types.h"
+
+#define MAX_BYTES_PER_READ 70
 static unsigned char rx[MAX_BYTES_PER_READ]; /* Receive buffer from the LKM */
 
+#define BULK_BYTES (64 << 20)
+#define SEEDED_BYTES 4096
+
+static const char *gen_names[] = {
+    [XORO_128_PLUS] = "xoroshiro128+",
+    [XORO_128_PLUSPLUS] = "xoroshiro128++",
+    [XOSHIRO_256_STARSTAR] = "xoshiro256**",
+};
+
+static int config(int fd, xoro_gen_t gen, uint32_t flags, uint64_t seed)
+{
+    struct xoro_config cfg = {.gen = gen, .flags = flags, .seed = seed};
+
+    return ioctl(fd, XORO_IOC_CONFIG, &cfg);
+}
+
 void zero_rx(void)
 {
     for (int b_idx = 0; b_idx < MAX_BYTES_PER_READ; b_idx++) {
@@ -24,26 +45,121 @@ int main(int argc, char *argv[])
     }
 
     /* Test reading different numbers of bytes. */
-    for (size_t n_bytes = 1; n_bytes < 70; n_bytes++) {
+    for (size_t n_bytes = 1; n_bytes < MAX_BYTES_PER_READ; n_bytes++) {
         /* Clear/zero the buffer before copying in read data. */
         zero_rx();
 
         /* Read the response from the LKM. */
         ssize_t n_bytes_read = read(fd, rx, n_bytes);
 
-        if (0 > n_bytes_read) {
+        if (n_bytes_read != (ssize_t) n_bytes) {
             perror("Failed to read all bytes.");
 
             return errno;
         }
 
+        /* Only the first 8 bytes fit in the printed value. */
         uint64_t value_ = 0;
-        for (size_t b_idx = 0; b_idx < n_bytes_read; b_idx++) {
+        for (size_t b_idx = 0; b_idx < n_bytes_read && b_idx < 8; b_idx++) {
             unsigned char b = rx[b_idx];
             value_ |= ((uint64_t) b << (8 * b_idx));
         }
         printf("value: %lu\n", value_);
     }
+
+    /* A second reader gets its own, independent stream. */
+    int fd2 = open("/dev/xoro", O_RDONLY);
+    if (0 > fd2) {
+        perror("Failed to open the device twice.");
+        return errno;
+    }
+    uint64_t a, b;
+    if (read(fd, &a, sizeof(a)) != sizeof(a) ||
+        read(fd2, &b, sizeof(b)) != sizeof(b) || a == b) {
+        fprintf(stderr, "Readers do not get separate streams.\n");
+        return 1;
+    }
+    close(fd2);
+
+    /* The same generator and seed give the same bytes on every open. */
+    static unsigned char seeded[2][SEEDED_BYTES];
+    for (int gen = XORO_128_PLUS; gen <= XOSHIRO_256_STARSTAR; gen++) {
+        for (int i = 0; i < 2; i++) {
+            int fd_ = open("/dev/xoro", O_RDONLY);
+            if (0 > fd_ || config(fd_, gen, XORO_SEED, 42) ||
+                read(fd_, seeded[i], SEEDED_BYTES) != SEEDED_BYTES) {
+                perror("Failed to read a seeded stream.");
+                return errno;
+            }
+            close(fd_);
+        }
+        if (memcmp(seeded[0], seeded[1], SEEDED_BYTES)) {
+            fprintf(stderr, "%s: seed does not repeat the stream.\n",
+                    gen_names[gen]);
+            return 1;
+        }
+    }
+    if (config(fd, XOSHIRO_256_STARSTAR + 1, 0, 0) != -1 || errno != EINVAL) {
+        fprintf(stderr, "Unknown generator accepted.\n");
+        return 1;
+    }
+
+    /* Keys drawn by XORO_IOC_FILL stay in range and keep their shape. */
+    int16_t keys[SEEDED_BYTES];
+    struct xoro_fill req = {
+        .buf = (uintptr_t) keys,
+        .count = SEEDED_BYTES,
+        .lo = -1000,
+        .hi = 1000,
+        .dist = XORO_DIST_GAUSSIAN,
+        .width = sizeof(*keys),
+    };
+    if (ioctl(fd, XORO_IOC_FILL, &req)) {
+        perror("Failed to fill keys.");
+        return errno;
+    }
+    for (size_t i = 0; i < SEEDED_BYTES; i++) {
+        if (keys[i] < req.lo || keys[i] > req.hi) {
+            fprintf(stderr, "Key %d out of [%lld, %lld].\n", keys[i],
+                    (long long) req.lo, (long long) req.hi);
+            return 1;
+        }
+    }
+    req.dist = XORO_DIST_SORTED;
+    if (ioctl(fd, XORO_IOC_FILL, &req)) {
+        perror("Failed to fill keys.");
+        return errno;
+    }
+    for (size_t i = 1; i < SEEDED_BYTES; i++) {
+        if (keys[i] != (keys[i - 1] == req.hi ? req.lo : keys[i - 1] + 1)) {
+            fprintf(stderr, "Sorted keys do not count up.\n");
+            return 1;
+        }
+    }
+
+    /* Bulk throughput of every generator. */
+    char *bulk = malloc(BULK_BYTES);
+    struct timespec start, end;
+    if (!bulk)
+        return ENOMEM;
+    for (int gen = XORO_128_PLUS; gen <= XOSHIRO_256_STARSTAR; gen++) {
+        if (config(fd, gen, 0, 0)) {
+            perror("Failed to select the generator.");
+            return errno;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ssize_t n_bulk = read(fd, bulk, BULK_BYTES);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (n_bulk != BULK_BYTES) {
+            perror("Failed to read in bulk.");
+            return errno;
+        }
+        double secs =
+            (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("bulk %s: %d MiB in %.3f s (%.1f MiB/s)\n", gen_names[gen],
+               BULK_BYTES >> 20, secs, (BULK_BYTES >> 20) / secs);
+    }
+    free(bulk);
     fflush(stdout);
 
     return 0;
@@ -1,82 +1,228 @@
 #include "timsort.h"
 #include <linux/slab.h>
+#include <linux/string.h>
+
+#include "sort.h"
 
 #define likely(x) __builtin_expect(!!(x), 1)
 #define unlikely(x) __builtin_expect(!!(x), 0)
 
-static struct list_head *merge(
-    void *priv,
-    bool (*cmp)(void *priv, struct list_head *, struct list_head *, bool),
-    struct list_head *a,
-    struct list_head *b,
-    bool descend)
+/* A run that wins this many comparisons in a row makes the merge gallop. */
+#define MIN_GALLOP 7
+
+/* State of one timsort_algo() call, so that any number of them can run at
+ * once.
+ */
+struct timsort_ctx {
+    void *priv;
+    list_cmp_func_t cmp;
+    size_t stk_size; /* runs on the stack */
+
+    /* Current threshold for galloping. As in CPython's timsort, it drops
+     * while galloping pays off and rises when it does not, across all
+     * merges of a sort.
+     */
+    size_t min_gallop;
+
+    unsigned int work; /* since the last cond_resched(), see sort_resched() */
+};
+
+/* Whether node goes before key; ties go to run a, which comes first. */
+static inline bool gallop_before(struct timsort_ctx *ctx,
+                                 struct list_head *node,
+                                 struct list_head *key,
+                                 bool from_a,
+                                 bool descend)
 {
-    struct list_head *head = NULL, **tail = &head;
+    return from_a ? !ctx->cmp(ctx->priv, node, key, descend)
+                  : ctx->cmp(ctx->priv, key, node, descend);
+}
+
+/* Find the longest prefix of list that goes before key: probe the nodes at
+ * 0, 1, 3, 7, ... until one fails, then binary search the last gap. The
+ * nodes between probes are walked, but never compared. Returns the last
+ * node of the prefix, or NULL if it is empty, and its length in *count.
+ */
+static struct list_head *gallop(struct timsort_ctx *ctx,
+                                struct list_head *list,
+                                struct list_head *key,
+                                bool from_a,
+                                bool descend,
+                                size_t *count)
+{
+    struct list_head *last = NULL, *p = list;
+    size_t good = 0, bad, idx = 0, step = 1, i;
 
     for (;;) {
-        /* if equal, take 'a' -- important for sort stability */
-        if (!cmp(priv, a, b, descend)) {
-            *tail = a;
-            tail = &a->next;
-            a = a->next;
-            if (!a) {
-                *tail = b;
-                break;
-            }
+        sort_resched(&ctx->work);
+        if (!gallop_before(ctx, p, key, from_a, descend)) {
+            bad = idx;
+            break;
+        }
+        last = p;
+        good = idx + 1;
+        if (!p->next) {
+            *count = good;
+            return last;
+        }
+        for (i = 0; i < step && p->next; i++, idx++)
+            p = p->next;
+        step *= 2;
+    }
+
+    while (good < bad) {
+        size_t mid = good + (bad - good) / 2;
+        struct list_head *q = last ? last->next : list;
+
+        for (i = good; i < mid; i++)
+            q = q->next;
+        if (gallop_before(ctx, q, key, from_a, descend)) {
+            last = q;
+            good = mid + 1;
         } else {
-            *tail = b;
-            tail = &b->next;
-            b = b->next;
-            if (!b) {
-                *tail = a;
-                break;
-            }
+            bad = mid;
         }
     }
-    return head;
+    *count = good;
+    return last;
+}
+
+/* Link first .. last after tail and return the new tail. The prev links
+ * are only kept up to date for the final merge.
+ */
+static inline struct list_head *append(struct list_head *tail,
+                                       struct list_head *first,
+                                       struct list_head *last,
+                                       bool link_prev)
+{
+    tail->next = first;
+    if (!link_prev)
+        return last;
+    for (;;) {
+        first->prev = tail;
+        tail = first;
+        if (first == last)
+            return tail;
+        first = first->next;
+    }
 }
 
-static void merge_final(
-    void *priv,
-    bool (*cmp)(void *priv, struct list_head *, struct list_head *, bool),
-    struct list_head *head,
-    struct list_head *a,
-    struct list_head *b,
-    bool descend)
+/* Merge runs a and b after tail and return the last node linked. Once one
+ * run wins min_gallop times in a row, whole stretches of it are found by
+ * gallop() and linked at once, until neither run wins MIN_GALLOP at a time.
+ */
+static struct list_head *merge_runs(struct timsort_ctx *ctx,
+                                    struct list_head *tail,
+                                    struct list_head *a,
+                                    struct list_head *b,
+                                    bool descend,
+                                    bool link_prev)
 {
-    struct list_head *tail = head;
-    size_t count = 0;
+    size_t wins_a = 0, wins_b = 0, count = 0;
 
     for (;;) {
+        sort_resched(&ctx->work);
         /* if equal, take 'a' -- important for sort stability */
-        if (!cmp(priv, a, b, descend)) {
-            tail->next = a;
-            a->prev = tail;
-            tail = a;
+        if (!ctx->cmp(ctx->priv, a, b, descend)) {
+            tail = append(tail, a, a, link_prev);
             a = a->next;
             if (!a)
-                break;
+                goto remainder;
+            wins_b = 0;
+            if (++wins_a < ctx->min_gallop)
+                continue;
         } else {
-            tail->next = b;
-            b->prev = tail;
-            tail = b;
+            tail = append(tail, b, b, link_prev);
             b = b->next;
             if (!b) {
                 b = a;
-                break;
+                goto remainder;
+            }
+            wins_a = 0;
+            if (++wins_b < ctx->min_gallop)
+                continue;
+        }
+
+        for (;;) {
+            struct list_head *last;
+            size_t na, nb;
+
+            ctx->min_gallop -= ctx->min_gallop > 1;
+
+            last = gallop(ctx, a, b, true, descend, &na);
+            if (last) {
+                tail = append(tail, a, last, link_prev);
+                a = last->next;
+                if (!a)
+                    goto remainder;
+            }
+
+            /* The head of b now goes before a, so it needs no comparison. */
+            tail = append(tail, b, b, link_prev);
+            b = b->next;
+            if (!b) {
+                b = a;
+                goto remainder;
             }
+
+            last = gallop(ctx, b, a, false, descend, &nb);
+            if (last) {
+                tail = append(tail, b, last, link_prev);
+                b = last->next;
+                if (!b) {
+                    b = a;
+                    goto remainder;
+                }
+            }
+
+            /* Likewise for the head of a. */
+            tail = append(tail, a, a, link_prev);
+            a = a->next;
+            if (!a)
+                goto remainder;
+
+            if (na < MIN_GALLOP && nb < MIN_GALLOP)
+                break;
         }
+        /* Penalize leaving galloping mode */
+        ctx->min_gallop++;
+        wins_a = wins_b = 0;
     }
 
+remainder:
     /* Finish linking remainder of list b on to tail */
     tail->next = b;
+    if (!link_prev)
+        return tail;
     do {
         if (unlikely(!++count))
-            cmp(priv, b, b, descend);
+            ctx->cmp(ctx->priv, b, b, descend);
+        sort_resched(&ctx->work);
         b->prev = tail;
         tail = b;
         b = b->next;
     } while (b);
+    return tail;
+}
+
+static struct list_head *merge(struct timsort_ctx *ctx,
+                               struct list_head *a,
+                               struct list_head *b,
+                               bool descend)
+{
+    struct list_head head;
+
+    merge_runs(ctx, &head, a, b, descend, false);
+    return head.next;
+}
+
+static void merge_final(struct timsort_ctx *ctx,
+                        struct list_head *head,
+                        struct list_head *a,
+                        struct list_head *b,
+                        bool descend)
+{
+    struct list_head *tail = merge_runs(ctx, head, a, b, descend, true);
 
     /* And the final links to make a circular doubly-linked list */
     tail->next = head;
@@ -97,8 +243,6 @@ struct pair {
     struct list_head *head, *next;
 };
 
-static size_t stk_size;
-
 static void build_prev_link(struct list_head *head,
                             struct list_head *tail,
                             struct list_head *list)
@@ -115,9 +259,72 @@ static void build_prev_link(struct list_head *head,
     head->prev = tail;
 }
 
-static struct pair find_run(void *priv,
+/* Upper bound on minrun, so short runs can be extended in an array. */
+#define MAX_MINRUN 64
+
+/* As in CPython: n divided by a power of two, rounded up, that lands in
+ * [MAX_MINRUN / 2, MAX_MINRUN]. Then n / minrun is a power of two or a
+ * little less, which keeps the merges balanced.
+ */
+static size_t compute_minrun(size_t n)
+{
+    size_t r = 0;
+
+    while (n >= MAX_MINRUN) {
+        r |= n & 1;
+        n >>= 1;
+    }
+    return n + r;
+}
+
+/* Extend the NULL-terminated run at *head, len nodes long, to minrun nodes
+ * by binary insertion of the nodes that follow it at *next. Returns the
+ * new length.
+ */
+static size_t extend_run(struct timsort_ctx *ctx,
+                         struct list_head **head,
+                         struct list_head **next,
+                         size_t len,
+                         size_t minrun)
+{
+    struct list_head *run[MAX_MINRUN], *node = *head, *rest = *next;
+    size_t i;
+
+    for (i = 0; i < len; i++, node = node->next)
+        run[i] = node;
+
+    for (; len < minrun && rest; len++) {
+        size_t lo = 0, hi = len;
+
+        node = rest;
+        rest = rest->next;
+        sort_resched(&ctx->work);
+
+        /* Insert after equal nodes -- important for sort stability */
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+
+            if (ctx->cmp(ctx->priv, run[mid], node, 0))
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        memmove(&run[lo + 1], &run[lo], (len - lo) * sizeof(*run));
+        run[lo] = node;
+    }
+
+    for (i = 0; i + 1 < len; i++)
+        run[i]->next = run[i + 1];
+    run[len - 1]->next = NULL;
+
+    *head = run[0];
+    *next = rest;
+    return len;
+}
+
+static struct pair find_run(struct timsort_ctx *ctx,
                             struct list_head *list,
-                            list_cmp_func_t cmp)
+                            size_t minrun)
 {
     size_t len = 1;
     struct list_head *next = list->next, *head = list;
@@ -128,76 +335,77 @@ static struct pair find_run(void *priv,
         return result;
     }
 
-    if (cmp(priv, list, next, 0) > 0) {
+    if (ctx->cmp(ctx->priv, list, next, 0) > 0) {
         /* decending run, also reverse the list */
         struct list_head *prev = NULL;
         do {
+            sort_resched(&ctx->work);
             len++;
             list->next = prev;
             prev = list;
             list = next;
             next = list->next;
             head = list;
-        } while (next && cmp(priv, list, next, 0) > 0);
+        } while (next && ctx->cmp(ctx->priv, list, next, 0) > 0);
         list->next = prev;
     } else {
         do {
+            sort_resched(&ctx->work);
             len++;
             list = next;
             next = list->next;
-        } while (next && cmp(priv, list, next, 0) == 0);
+        } while (next && ctx->cmp(ctx->priv, list, next, 0) == 0);
         list->next = NULL;
     }
+    if (len < minrun && next)
+        len = extend_run(ctx, &head, &next, len, minrun);
     head->prev = NULL;
     head->next->prev = (struct list_head *) len;
     result.head = head, result.next = next;
     return result;
 }
 
-static struct list_head *merge_at(void *priv,
-                                  list_cmp_func_t cmp,
+static struct list_head *merge_at(struct timsort_ctx *ctx,
                                   struct list_head *at)
 {
     size_t len = run_size(at) + run_size(at->prev);
     struct list_head *prev = at->prev->prev;
-    struct list_head *list = merge(priv, cmp, at->prev, at, 0);
+    struct list_head *list = merge(ctx, at->prev, at, 0);
     list->prev = prev;
     list->next->prev = (struct list_head *) len;
-    --stk_size;
+    --ctx->stk_size;
     return list;
 }
 
-static struct list_head *merge_force_collapse(void *priv,
-                                              list_cmp_func_t cmp,
+static struct list_head *merge_force_collapse(struct timsort_ctx *ctx,
                                               struct list_head *tp)
 {
-    while (stk_size >= 3) {
+    while (ctx->stk_size >= 3) {
         if (run_size(tp->prev->prev) < run_size(tp)) {
-            tp->prev = merge_at(priv, cmp, tp->prev);
+            tp->prev = merge_at(ctx, tp->prev);
         } else {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(ctx, tp);
         }
     }
     return tp;
 }
 
-static struct list_head *merge_collapse(void *priv,
-                                        list_cmp_func_t cmp,
+static struct list_head *merge_collapse(struct timsort_ctx *ctx,
                                         struct list_head *tp)
 {
     int n;
-    while ((n = stk_size) >= 2) {
+    while ((n = ctx->stk_size) >= 2) {
         if ((n >= 3 &&
              run_size(tp->prev->prev) <= run_size(tp->prev) + run_size(tp)) ||
             (n >= 4 && run_size(tp->prev->prev->prev) <=
                            run_size(tp->prev->prev) + run_size(tp->prev))) {
             if (run_size(tp->prev->prev) < run_size(tp)) {
-                tp->prev = merge_at(priv, cmp, tp->prev);
+                tp->prev = merge_at(ctx, tp->prev);
             } else {
-                tp = merge_at(priv, cmp, tp);
+                tp = merge_at(ctx, tp);
             }
         } else if (run_size(tp->prev) <= run_size(tp)) {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(ctx, tp);
         } else {
             break;
         }
@@ -208,36 +416,48 @@ static struct list_head *merge_collapse(void *priv,
 
 void timsort_algo(void *priv, struct list_head *head, list_cmp_func_t cmp)
 {
+    struct timsort_ctx ctx = {
+        .priv = priv,
+        .cmp = cmp,
+        .min_gallop = MIN_GALLOP,
+    };
+
     printk(KERN_INFO "Start timsort_algo\n");
-    stk_size = 0;
 
     struct list_head *list = head->next, *tp = NULL;
     if (head == head->prev)
         return;
 
+    size_t n = 0, minrun;
+    for (struct list_head *node = list; node != head; node = node->next) {
+        sort_resched(&ctx.work);
+        n++;
+    }
+    minrun = compute_minrun(n);
+
     /* Convert to a null-terminated singly-linked list. */
     head->prev->next = NULL;
 
     do {
         /* Find next run */
-        struct pair result = find_run(priv, list, cmp);
+        struct pair result = find_run(&ctx, list, minrun);
         result.head->prev = tp;
         tp = result.head;
         list = result.next;
-        stk_size++;
-        tp = merge_collapse(priv, cmp, tp);
+        ctx.stk_size++;
+        tp = merge_collapse(&ctx, tp);
     } while (list);
 
     /* End of input; merge together all the runs. */
-    tp = merge_force_collapse(priv, cmp, tp);
+    tp = merge_force_collapse(&ctx, tp);
 
     /* The final merge; rebuild prev links */
     struct list_head *stk0 = tp, *stk1 = stk0->prev;
     while (stk1 && stk1->prev)
         stk0 = stk0->prev, stk1 = stk1->prev;
-    if (stk_size <= 1) {
+    if (ctx.stk_size <= 1) {
         build_prev_link(head, head, stk0);
         return;
     }
-    merge_final(priv, cmp, head, stk1, stk0, 0);
+    merge_final(&ctx, head, stk1, stk0, 0);
 }
\ No newline at end of file
@@ -8,6 +8,12 @@ typedef struct {
     struct list_head list;
 } element_t;
 
+/* Node for records of any size, which stay in the caller's buffer. */
+typedef struct {
+    const void *rec;
+    struct list_head list;
+} record_t;
+
 
 /* Compare function type for list */
 typedef bool (*list_cmp_func_t)(void *,
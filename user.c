@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -10,17 +11,12 @@
 #include <unistd.h>
 
 #include "sort_types.h"
+#include "xoro_types.h"
 
 #define KSORT_DEV "/dev/sort"
 #define XORO_DEV "/dev/xoro"
 
-#define TIMSORT 0
-#define LINUXSORT 1
-#define PDQSORT 2
-#define QSORT 3
-
-#define MAX_BYTES_PER_READ 8
-static unsigned char rx[MAX_BYTES_PER_READ]; /* Receive buffer from the LKM */
+#define MERGE_RUNS 4
 
 typedef struct {
     unsigned long long qsort_user;
@@ -32,13 +28,13 @@ typedef struct {
 } sorttime;
 
 sorttime time_analysis(size_t);
-
-void zero_rx(void)
-{
-    for (int b_idx = 0; b_idx < MAX_BYTES_PER_READ; b_idx++) {
-        rx[b_idx] = 0;
-    }
-}
+bool merge_test(size_t);
+bool stream_test(size_t);
+bool numa_test(size_t);
+bool inplace_test(size_t);
+bool strings_test(size_t);
+bool file_test(size_t);
+bool count_test(size_t);
 
 int main()
 {
@@ -47,6 +43,14 @@ int main()
     size_t start = 1000, end = 20000;
     size_t step = 500;
 
+    merge_test(end);
+    stream_test(end);
+    numa_test(end);
+    inplace_test(end);
+    strings_test(end);
+    file_test(end);
+    count_test(end);
+
     for (size_t k = start; k <= end; k += step) {
         result = time_analysis(k);
         fprintf(file, "%zu,%llu,%llu,%llu,%llu,%llu,%llu\n", k,
@@ -81,25 +85,18 @@ sorttime time_analysis(size_t num)
         goto error;
     }
 
-    for (size_t n_bytes = 1; n_bytes <= n_elements; n_bytes++) {
-        /* Clear/zero the buffer before copying in read data. */
-        zero_rx();
-
-        /* Read the response from the LKM. */
-        ssize_t n_bytes_read = read(fdxoro, rx, n_bytes);
-
-        if (0 > n_bytes_read) {
-            perror("Failed to read all bytes.");
-
-            goto error;
-        }
-
-        uint64_t value_ = 0;
-        for (int b_idx = 0; b_idx < n_bytes_read; b_idx++) {
-            unsigned char b = rx[b_idx];
-            value_ |= ((uint64_t) b << (8 * b_idx));
-        }
-        xorobuf[n_bytes - 1] = value_ % n_elements;
+    /* The keys come out of /dev/xoro already reduced to [0, n). */
+    struct xoro_fill req = {
+        .buf = (uintptr_t) xorobuf,
+        .count = n_elements,
+        .lo = 0,
+        .hi = n_elements - 1,
+        .dist = XORO_DIST_UNIFORM,
+        .width = sizeof(int),
+    };
+    if (ioctl(fdxoro, XORO_IOC_FILL, &req)) {
+        perror("Failed to generate the keys");
+        goto error;
     }
 
     { /*Timsort test*/
@@ -148,7 +145,7 @@ sorttime time_analysis(size_t num)
     { /*Linux sort test*/
         memcpy(inbuf, xorobuf, size);
 
-        sort_method_t method = LINUXSORT;
+        sort_method_t method = LINUX_SORT;
         if (write(fd, &method, sizeof(method)) != sizeof(method)) {
             perror("Failed to set sort method");
             close(fd);
@@ -240,3 +237,361 @@ error:
         close(fdxoro);
     return time;
 }
+
+bool merge_test(size_t n_elements)
+{
+    const uint32_t nr_runs = MERGE_RUNS;
+    uint64_t bounds[MERGE_RUNS + 1];
+    int fd = open(KSORT_DEV, O_RDWR);
+    int *buf = malloc(n_elements * sizeof(int));
+    bool pass = false;
+
+    if (fd < 0 || !buf)
+        goto out;
+
+    /* Every run counts up from a different start, so the runs interleave. */
+    for (uint32_t r = 0; r <= nr_runs; r++)
+        bounds[r] = n_elements * r / nr_runs;
+    for (uint32_t r = 0; r < nr_runs; r++)
+        for (uint64_t i = bounds[r]; i < bounds[r + 1]; i++)
+            buf[i] = (int) (r + (i - bounds[r]) * nr_runs);
+
+    struct sort_merge_req req = {
+        .buf = (uintptr_t) buf,
+        .bounds = (uintptr_t) bounds,
+        .nr_runs = nr_runs,
+    };
+    if (ioctl(fd, SORT_IOC_MERGE, &req) < 0) {
+        perror("Failed to merge runs");
+        goto out;
+    }
+
+    pass = true;
+    for (size_t i = 1; i < n_elements; i++) {
+        if (buf[i] < buf[i - 1]) {
+            pass = false;
+            break;
+        }
+    }
+    printf("Merging %s!\n", pass ? "succeeded" : "failed");
+
+out:
+    free(buf);
+    if (fd >= 0)
+        close(fd);
+    return pass;
+}
+
+bool stream_test(size_t n_elements)
+{
+    const size_t chunk = 1000;
+    size_t size = n_elements * sizeof(int);
+    int fd = open(KSORT_DEV, O_RDWR);
+    int *buf = malloc(size);
+    bool pass = false;
+
+    if (fd < 0 || !buf)
+        goto out;
+
+    for (size_t i = 0; i < n_elements; i++)
+        buf[i] = (int) ((i * 7919) % n_elements);
+
+    if (ioctl(fd, SORT_IOC_STREAM, size) < 0) {
+        perror("Failed to start stream");
+        goto out;
+    }
+
+    for (size_t i = 0; i < n_elements; i += chunk) {
+        size_t n = n_elements - i < chunk ? n_elements - i : chunk;
+        ssize_t bytes = (ssize_t) (n * sizeof(int));
+
+        if (write(fd, buf + i, bytes) != bytes) {
+            perror("Failed to write chunk");
+            goto out;
+        }
+    }
+
+    if (read(fd, buf, size) != (ssize_t) size) {
+        perror("Failed to read stream");
+        goto out;
+    }
+
+    pass = true;
+    for (size_t i = 1; i < n_elements; i++) {
+        if (buf[i] < buf[i - 1]) {
+            pass = false;
+            break;
+        }
+    }
+    printf("Streaming %s!\n", pass ? "succeeded" : "failed");
+
+out:
+    free(buf);
+    if (fd >= 0)
+        close(fd);
+    return pass;
+}
+
+bool numa_test(size_t n_elements)
+{
+    size_t size = n_elements * sizeof(int);
+    int fd = open(KSORT_DEV, O_RDWR);
+    int *buf = malloc(size);
+    bool pass = false;
+
+    if (fd < 0 || !buf)
+        goto out;
+
+    for (size_t i = 0; i < n_elements; i++)
+        buf[i] = (int) ((i * 7919) % n_elements);
+
+    if (ioctl(fd, SORT_IOC_NUMA, 1) < 0) {
+        perror("Failed to select NUMA mode");
+        goto out;
+    }
+
+    if (read(fd, buf, size) != (ssize_t) size) {
+        perror("Failed to read NUMA sort");
+        goto out;
+    }
+
+    pass = true;
+    for (size_t i = 1; i < n_elements; i++) {
+        if (buf[i] < buf[i - 1]) {
+            pass = false;
+            break;
+        }
+    }
+    printf("NUMA sorting %s!\n", pass ? "succeeded" : "failed");
+
+out:
+    free(buf);
+    if (fd >= 0)
+        close(fd);
+    return pass;
+}
+
+/* Records with few distinct keys, tagged with their input position, so
+ * the result shows whether equal keys kept their order.
+ */
+bool inplace_test(size_t n_elements)
+{
+    struct {
+        int key;
+        int seq;
+    } *rec = malloc(n_elements * sizeof(*rec));
+    struct sort_layout layout = {
+        .es = sizeof(*rec),
+        .nr_keys = 1,
+        .keys = {{.offset = 0, .width = sizeof(int), .is_signed = 1}},
+    };
+    sort_method_t method = INPLACE_SORT;
+    size_t size = n_elements * sizeof(*rec);
+    int fd = open(KSORT_DEV, O_RDWR);
+    bool pass = false;
+
+    if (fd < 0 || !rec)
+        goto out;
+
+    for (size_t i = 0; i < n_elements; i++) {
+        rec[i].key = (int) ((i * 7919) % 16);
+        rec[i].seq = (int) i;
+    }
+
+    if (write(fd, &method, sizeof(method)) != sizeof(method) ||
+        ioctl(fd, SORT_IOC_LAYOUT, &layout) < 0) {
+        perror("Failed to set up in-place sort");
+        goto out;
+    }
+
+    if (read(fd, rec, size) != (ssize_t) size) {
+        perror("Failed to read in-place sort");
+        goto out;
+    }
+
+    pass = true;
+    for (size_t i = 1; i < n_elements; i++) {
+        if (rec[i].key < rec[i - 1].key ||
+            (rec[i].key == rec[i - 1].key && rec[i].seq < rec[i - 1].seq)) {
+            pass = false;
+            break;
+        }
+    }
+    printf("In-place stable sorting %s!\n", pass ? "succeeded" : "failed");
+
+out:
+    free(rec);
+    if (fd >= 0)
+        close(fd);
+    return pass;
+}
+
+/* Decimal numbers as strings under a common prefix, so their order differs
+ * from the numeric one and every comparison goes past the prefix.
+ */
+bool strings_test(size_t n_strings)
+{
+    const char *prefix = "https://example.com/item/";
+    size_t blob_len = n_strings * (strlen(prefix) + 20);
+    char *blob = malloc(blob_len);
+    struct sort_string *strings = malloc(n_strings * sizeof(*strings));
+    int fd = open(KSORT_DEV, O_RDWR);
+    size_t used = 0;
+    bool pass = false;
+
+    if (fd < 0 || !blob || !strings)
+        goto out;
+
+    for (size_t i = 0; i < n_strings; i++) {
+        int len = sprintf(blob + used, "%s%zu", prefix,
+                          (i * 7919) % n_strings);
+
+        strings[i].offset = used;
+        strings[i].len = len;
+        strings[i].reserved = 0;
+        used += len;
+    }
+
+    struct sort_strings_req req = {
+        .blob = (uintptr_t) blob,
+        .blob_len = used,
+        .strings = (uintptr_t) strings,
+        .nr_strings = n_strings,
+    };
+    if (ioctl(fd, SORT_IOC_STRINGS, &req) < 0) {
+        perror("Failed to sort strings");
+        goto out;
+    }
+
+    pass = true;
+    for (size_t i = 1; i < n_strings; i++) {
+        const struct sort_string *a = &strings[i - 1], *b = &strings[i];
+        size_t len = a->len < b->len ? a->len : b->len;
+        int r = memcmp(blob + a->offset, blob + b->offset, len);
+
+        if (r > 0 || (r == 0 && a->len > b->len)) {
+            pass = false;
+            break;
+        }
+    }
+    printf("String sorting %s!\n", pass ? "succeeded" : "failed");
+
+out:
+    free(strings);
+    free(blob);
+    if (fd >= 0)
+        close(fd);
+    return pass;
+}
+
+/* A memory limit far below the file size forces the external merge. */
+bool file_test(size_t n_elements)
+{
+    size_t size = n_elements * sizeof(int);
+    int fd = open(KSORT_DEV, O_RDWR);
+    FILE *data = tmpfile(), *runs = tmpfile();
+    int *buf = malloc(size);
+    bool pass = false;
+
+    if (fd < 0 || !data || !runs || !buf)
+        goto out;
+
+    for (size_t i = 0; i < n_elements; i++)
+        buf[i] = (int) ((i * 7919) % n_elements);
+    if (pwrite(fileno(data), buf, size, 0) != (ssize_t) size) {
+        perror("Failed to write the file to sort");
+        goto out;
+    }
+
+    struct sort_file_req req = {
+        .fd = fileno(data),
+        .tmp_fd = fileno(runs),
+        .mem_limit = size / 8,
+    };
+
+    /* Runs can only be written in place, which O_APPEND rules out. */
+    int flags = fcntl(fileno(runs), F_GETFL);
+    fcntl(fileno(runs), F_SETFL, flags | O_APPEND);
+    if (ioctl(fd, SORT_IOC_FILE, &req) == 0 || errno != EINVAL) {
+        fprintf(stderr, "File sort accepted an O_APPEND file\n");
+        goto out;
+    }
+    fcntl(fileno(runs), F_SETFL, flags);
+
+    if (ioctl(fd, SORT_IOC_FILE, &req) < 0) {
+        perror("Failed to sort file");
+        goto out;
+    }
+
+    if (pread(fileno(data), buf, size, 0) != (ssize_t) size) {
+        perror("Failed to read the sorted file");
+        goto out;
+    }
+
+    pass = true;
+    for (size_t i = 0; i < n_elements; i++) {
+        if (buf[i] != (int) i) {
+            pass = false;
+            break;
+        }
+    }
+    printf("File sorting %s!\n", pass ? "succeeded" : "failed");
+
+out:
+    free(buf);
+    if (runs)
+        fclose(runs);
+    if (data)
+        fclose(data);
+    if (fd >= 0)
+        close(fd);
+    return pass;
+}
+
+/* A permutation of the n keys from INT_MIN, then the same with the smallest
+ * key moved to INT_MAX, too wide a range to count, which has to fall back to
+ * quicksort.
+ */
+bool count_test(size_t n_elements)
+{
+    size_t size = n_elements * sizeof(int);
+    sort_method_t method = COUNT_SORT;
+    int fd = open(KSORT_DEV, O_RDWR);
+    int *buf = malloc(size);
+    bool pass = false;
+
+    if (fd < 0 || !buf)
+        goto out;
+
+    if (write(fd, &method, sizeof(method)) != sizeof(method)) {
+        perror("Failed to set sort method");
+        goto out;
+    }
+
+    for (int wide = 0; wide <= 1; wide++) {
+        for (size_t i = 0; i < n_elements; i++)
+            buf[i] = INT_MIN + (int) ((i * 7919) % n_elements);
+        if (wide)
+            buf[0] = INT_MAX;
+
+        if (read(fd, buf, size) != (ssize_t) size) {
+            perror("Failed to read counting sort");
+            pass = false;
+            goto out;
+        }
+
+        pass = buf[n_elements - 1] ==
+               (wide ? INT_MAX : INT_MIN + (int) n_elements - 1);
+        for (size_t i = 0; pass && i < n_elements - 1; i++)
+            pass = buf[i] == INT_MIN + (int) (i + wide);
+        if (!pass)
+            break;
+    }
+    printf("Counting sort %s!\n", pass ? "succeeded" : "failed");
+
+out:
+    free(buf);
+    if (fd >= 0)
+        close(fd);
+    return pass;
+}
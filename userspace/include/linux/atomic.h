@@ -0,0 +1,30 @@
+#ifndef KSHIM_LINUX_ATOMIC_H
+#define KSHIM_LINUX_ATOMIC_H
+
+#include <linux/types.h>
+
+typedef struct {
+    int counter;
+} atomic_t;
+
+typedef struct {
+    s64 counter;
+} atomic64_t;
+
+#define ATOMIC_INIT(i) {(i)}
+#define ATOMIC64_INIT(i) {(i)}
+
+#define atomic_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic_set(v, i) __atomic_store_n(&(v)->counter, i, __ATOMIC_RELAXED)
+#define atomic_inc(v) __atomic_fetch_add(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec_and_test(v) \
+    (__atomic_sub_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST) == 0)
+
+#define atomic64_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic64_add(i, v) \
+    __atomic_fetch_add(&(v)->counter, i, __ATOMIC_SEQ_CST)
+#define atomic64_inc(v) atomic64_add(1, v)
+#define atomic64_xchg(v, i) \
+    __atomic_exchange_n(&(v)->counter, i, __ATOMIC_SEQ_CST)
+
+#endif  // KSHIM_LINUX_ATOMIC_H
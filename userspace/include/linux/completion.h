@@ -0,0 +1,38 @@
+#ifndef KSHIM_LINUX_COMPLETION_H
+#define KSHIM_LINUX_COMPLETION_H
+
+#include <pthread.h>
+
+#include <linux/types.h>
+
+struct completion {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned int done;
+};
+
+static inline void init_completion(struct completion *x)
+{
+    pthread_mutex_init(&x->lock, NULL);
+    pthread_cond_init(&x->cond, NULL);
+    x->done = 0;
+}
+
+static inline void complete(struct completion *x)
+{
+    pthread_mutex_lock(&x->lock);
+    x->done++;
+    pthread_cond_signal(&x->cond);
+    pthread_mutex_unlock(&x->lock);
+}
+
+static inline void wait_for_completion(struct completion *x)
+{
+    pthread_mutex_lock(&x->lock);
+    while (!x->done)
+        pthread_cond_wait(&x->cond, &x->lock);
+    x->done--;
+    pthread_mutex_unlock(&x->lock);
+}
+
+#endif  // KSHIM_LINUX_COMPLETION_H
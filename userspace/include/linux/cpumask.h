@@ -0,0 +1,14 @@
+#ifndef KSHIM_LINUX_CPUMASK_H
+#define KSHIM_LINUX_CPUMASK_H
+
+#include <linux/types.h>
+
+/* CPUs are numbered 0 .. num_online_cpus() - 1, all of them online. */
+unsigned int num_online_cpus(void);
+
+#define nr_cpu_ids ((int) num_online_cpus())
+#define cpu_online_mask NULL
+#define cpumask_first(mask) 0
+#define cpumask_next(cpu, mask) ((cpu) + 1)
+
+#endif  // KSHIM_LINUX_CPUMASK_H
@@ -0,0 +1,7 @@
+#ifndef KSHIM_LINUX_EXPORT_H
+#define KSHIM_LINUX_EXPORT_H
+
+/* Everything in the library is visible already. */
+#define EXPORT_SYMBOL(sym)
+
+#endif  // KSHIM_LINUX_EXPORT_H
@@ -0,0 +1,6 @@
+#ifndef KSHIM_LINUX_KERNEL_H
+#define KSHIM_LINUX_KERNEL_H
+
+#include <linux/types.h>
+
+#endif  // KSHIM_LINUX_KERNEL_H
@@ -0,0 +1,8 @@
+#ifndef KSHIM_LINUX_KTIME_H
+#define KSHIM_LINUX_KTIME_H
+
+#include <linux/time.h>
+
+#define ktime_us_delta(later, earlier) (((later) - (earlier)) / 1000)
+
+#endif  // KSHIM_LINUX_KTIME_H
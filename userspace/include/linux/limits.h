@@ -0,0 +1,6 @@
+#ifndef KSHIM_LINUX_LIMITS_H
+#define KSHIM_LINUX_LIMITS_H
+
+#include <limits.h>
+
+#endif  // KSHIM_LINUX_LIMITS_H
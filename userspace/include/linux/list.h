@@ -0,0 +1,116 @@
+#ifndef KSHIM_LINUX_LIST_H
+#define KSHIM_LINUX_LIST_H
+
+#include <linux/types.h>
+
+#define LIST_HEAD_INIT(name) {&(name), &(name)}
+#define LIST_HEAD(name) struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+    list->next = list;
+    list->prev = list;
+}
+
+static inline void __list_add(struct list_head *new,
+                              struct list_head *prev,
+                              struct list_head *next)
+{
+    next->prev = new;
+    new->next = next;
+    new->prev = prev;
+    prev->next = new;
+}
+
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+    __list_add(new, head, head->next);
+}
+
+static inline void list_add_tail(struct list_head *new, struct list_head *head)
+{
+    __list_add(new, head->prev, head);
+}
+
+static inline void list_del(struct list_head *entry)
+{
+    entry->next->prev = entry->prev;
+    entry->prev->next = entry->next;
+    entry->next = NULL;
+    entry->prev = NULL;
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+    return head->next == head;
+}
+
+static inline void list_move_tail(struct list_head *list,
+                                  struct list_head *head)
+{
+    list->next->prev = list->prev;
+    list->prev->next = list->next;
+    list_add_tail(list, head);
+}
+
+/* Join list before head; list itself is left as it was. */
+static inline void list_splice_tail(struct list_head *list,
+                                    struct list_head *head)
+{
+    if (list_empty(list))
+        return;
+    list->next->prev = head->prev;
+    head->prev->next = list->next;
+    list->prev->next = head;
+    head->prev = list->prev;
+}
+
+static inline void list_splice_tail_init(struct list_head *list,
+                                         struct list_head *head)
+{
+    list_splice_tail(list, head);
+    INIT_LIST_HEAD(list);
+}
+
+/* Move the nodes of head up to and including entry to the empty list. */
+static inline void list_cut_position(struct list_head *list,
+                                     struct list_head *head,
+                                     struct list_head *entry)
+{
+    if (list_empty(head) || entry == head) {
+        INIT_LIST_HEAD(list);
+        return;
+    }
+    list->next = head->next;
+    list->next->prev = list;
+    list->prev = entry;
+    head->next = entry->next;
+    head->next->prev = head;
+    entry->next = list;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define list_first_entry(ptr, type, member) \
+    list_entry((ptr)->next, type, member)
+
+#define list_next_entry(pos, member) \
+    list_entry((pos)->member.next, typeof(*(pos)), member)
+
+#define list_for_each(pos, head) \
+    for (pos = (head)->next; pos != (head); pos = pos->next)
+
+#define list_for_each_safe(pos, n, head)                  \
+    for (pos = (head)->next, n = pos->next; pos != (head); \
+         pos = n, n = pos->next)
+
+#define list_for_each_entry(pos, head, member)                    \
+    for (pos = list_first_entry(head, typeof(*pos), member);      \
+         &pos->member != (head); pos = list_next_entry(pos, member))
+
+#define list_for_each_entry_safe(pos, n, head, member)            \
+    for (pos = list_first_entry(head, typeof(*pos), member),      \
+        n = list_next_entry(pos, member);                         \
+         &pos->member != (head); pos = n, n = list_next_entry(n, member))
+
+#endif  // KSHIM_LINUX_LIST_H
@@ -0,0 +1,13 @@
+#ifndef KSHIM_LINUX_LIST_SORT_H
+#define KSHIM_LINUX_LIST_SORT_H
+
+#include <linux/types.h>
+
+typedef int (*list_cmp_func_t)(void *,
+                               const struct list_head *,
+                               const struct list_head *);
+
+/* Stable merge sort, as lib/list_sort.c. */
+void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp);
+
+#endif  // KSHIM_LINUX_LIST_SORT_H
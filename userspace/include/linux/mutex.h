@@ -0,0 +1,19 @@
+#ifndef KSHIM_LINUX_MUTEX_H
+#define KSHIM_LINUX_MUTEX_H
+
+#include <pthread.h>
+
+#include <linux/types.h>
+
+struct mutex {
+    pthread_mutex_t m;
+};
+
+#define DEFINE_MUTEX(name) struct mutex name = {PTHREAD_MUTEX_INITIALIZER}
+
+#define mutex_init(lock) pthread_mutex_init(&(lock)->m, NULL)
+#define mutex_destroy(lock) pthread_mutex_destroy(&(lock)->m)
+#define mutex_lock(lock) pthread_mutex_lock(&(lock)->m)
+#define mutex_unlock(lock) pthread_mutex_unlock(&(lock)->m)
+
+#endif  // KSHIM_LINUX_MUTEX_H
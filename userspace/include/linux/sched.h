@@ -0,0 +1,7 @@
+#ifndef KSHIM_LINUX_SCHED_H
+#define KSHIM_LINUX_SCHED_H
+
+/* Pool threads are preempted like any other thread. */
+#define cond_resched() ((void) 0)
+
+#endif  // KSHIM_LINUX_SCHED_H
@@ -0,0 +1,32 @@
+#ifndef KSHIM_LINUX_SLAB_H
+#define KSHIM_LINUX_SLAB_H
+
+#include <stdlib.h>
+
+#include <linux/list.h>
+#include <linux/types.h>
+
+/* Allocations never sleep or fail differently in userspace, so the GFP
+ * flags are accepted and ignored.
+ */
+#define GFP_KERNEL 0
+
+#define kmalloc(size, flags) malloc(size)
+#define kzalloc(size, flags) calloc(1, size)
+#define kcalloc(n, size, flags) calloc(n, size)
+#define kmalloc_array(n, size, flags) kvmalloc_array(n, size, flags)
+#define kfree(ptr) free(ptr)
+
+#define kvmalloc(size, flags) malloc(size)
+#define kvmalloc_node(size, flags, node) malloc(size)
+#define kvcalloc(n, size, flags) calloc(n, size)
+#define kvfree(ptr) free(ptr)
+
+static inline void *kvmalloc_array(size_t n, size_t size, int flags)
+{
+    if (size && n > SIZE_MAX / size)
+        return NULL;
+    return malloc(n * size);
+}
+
+#endif  // KSHIM_LINUX_SLAB_H
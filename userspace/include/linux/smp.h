@@ -0,0 +1,9 @@
+#ifndef KSHIM_LINUX_SMP_H
+#define KSHIM_LINUX_SMP_H
+
+#include <linux/types.h>
+
+/* The pool thread running the caller, see userspace/kshim.c. */
+unsigned int raw_smp_processor_id(void);
+
+#endif  // KSHIM_LINUX_SMP_H
@@ -0,0 +1,24 @@
+#ifndef KSHIM_LINUX_SORT_H
+#define KSHIM_LINUX_SORT_H
+
+#include <linux/types.h>
+
+typedef int (*cmp_func_t)(const void *a, const void *b);
+typedef int (*cmp_r_func_t)(const void *a, const void *b, const void *priv);
+typedef void (*swap_func_t)(void *a, void *b, int size);
+
+/* Heapsort, as lib/sort.c, so LINUX_SORT costs the same as in the kernel. */
+void sort_r(void *base,
+            size_t num,
+            size_t size,
+            cmp_r_func_t cmp,
+            swap_func_t swap,
+            const void *priv);
+
+void sort(void *base,
+          size_t num,
+          size_t size,
+          cmp_func_t cmp,
+          swap_func_t swap);
+
+#endif  // KSHIM_LINUX_SORT_H
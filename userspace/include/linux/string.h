@@ -0,0 +1,8 @@
+#ifndef KSHIM_LINUX_STRING_H
+#define KSHIM_LINUX_STRING_H
+
+#include <string.h>
+
+#include <linux/types.h>
+
+#endif  // KSHIM_LINUX_STRING_H
@@ -0,0 +1,20 @@
+#ifndef KSHIM_LINUX_TIME_H
+#define KSHIM_LINUX_TIME_H
+
+#include <time.h>
+
+#include <linux/types.h>
+
+static inline ktime_t ktime_get(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ktime_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define ktime_sub(a, b) ((a) - (b))
+#define ktime_add(a, b) ((a) + (b))
+#define ktime_to_ns(kt) (kt)
+
+#endif  // KSHIM_LINUX_TIME_H
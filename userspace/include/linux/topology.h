@@ -0,0 +1,9 @@
+#ifndef KSHIM_LINUX_TOPOLOGY_H
+#define KSHIM_LINUX_TOPOLOGY_H
+
+#include <linux/cpumask.h>
+
+/* Every CPU of the pool belongs to a single node. */
+#define cpu_to_node(cpu) 0
+
+#endif  // KSHIM_LINUX_TOPOLOGY_H
@@ -0,0 +1,78 @@
+#ifndef KSHIM_LINUX_TYPES_H
+#define KSHIM_LINUX_TYPES_H
+
+/* Userspace stand-ins for the kernel types and helpers the sort engines
+ * use. Only what the engines need is provided, with the kernel's meaning.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef unsigned char u8, __u8;
+typedef unsigned short u16, __u16;
+typedef unsigned int u32, __u32;
+typedef unsigned long long u64, __u64;
+typedef signed char s8, __s8;
+typedef short s16, __s16;
+typedef int s32, __s32;
+typedef long long s64, __s64;
+
+#define U32_MAX ((u32) ~0U)
+
+typedef s64 ktime_t;
+
+struct list_head {
+    struct list_head *next, *prev;
+};
+
+#define __user
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define READ_ONCE(x) (*(const volatile typeof(x) *) &(x))
+#define WRITE_ONCE(x, val) (*(volatile typeof(x) *) &(x) = (val))
+
+#define BUILD_BUG_ON(cond) _Static_assert(!(cond), #cond)
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define round_up(x, y) (DIV_ROUND_UP(x, y) * (y))
+
+#define min(x, y) ((x) < (y) ? (x) : (y))
+#define max(x, y) ((x) > (y) ? (x) : (y))
+#define min_t(type, x, y) min((type) (x), (type) (y))
+#define max_t(type, x, y) max((type) (x), (type) (y))
+#define clamp(val, lo, hi) min(max(val, lo), hi)
+#define clamp_t(type, val, lo, hi) clamp((type) (val), (type) (lo), (type) (hi))
+
+#define swap(a, b)              \
+    do {                        \
+        typeof(a) __tmp = (a);  \
+        (a) = (b);              \
+        (b) = __tmp;            \
+    } while (0)
+
+#define container_of(ptr, type, member) \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+
+#define MAX_ERRNO 4095
+#define ERR_PTR(error) ((void *) (intptr_t) (error))
+#define PTR_ERR(ptr) ((long) (intptr_t) (ptr))
+#define IS_ERR(ptr) ((uintptr_t) (ptr) >= (uintptr_t) -MAX_ERRNO)
+
+/* Kernel log output is dropped; the engines only log progress. */
+#define KERN_ALERT ""
+#define KERN_ERR ""
+#define KERN_WARNING ""
+#define KERN_INFO ""
+#define printk(...) ((void) 0)
+#define pr_err(...) ((void) 0)
+#define pr_warn(...) ((void) 0)
+#define pr_info(...) ((void) 0)
+#define pr_debug(...) ((void) 0)
+
+#endif  // KSHIM_LINUX_TYPES_H
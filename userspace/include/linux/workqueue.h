@@ -0,0 +1,42 @@
+#ifndef KSHIM_LINUX_WORKQUEUE_H
+#define KSHIM_LINUX_WORKQUEUE_H
+
+#include <linux/list.h>
+#include <linux/types.h>
+
+struct work_struct;
+struct workqueue_struct;
+
+typedef void (*work_func_t)(struct work_struct *work);
+
+struct work_struct {
+    work_func_t func;
+    struct work_struct *next;    /* queue link */
+    struct workqueue_struct *wq; /* last queued on */
+    bool pending;
+};
+
+#define INIT_WORK(work, fn)                 \
+    do {                                    \
+        *(work) = (struct work_struct){0};  \
+        (work)->func = (fn);                \
+    } while (0)
+
+#define WQ_MAX_ACTIVE 512
+
+/* A pool of one pthread per online CPU. The cpu of queue_work_on() is only
+ * a hint: every thread takes work from one shared queue.
+ */
+struct workqueue_struct *alloc_workqueue(const char *fmt,
+                                         unsigned int flags,
+                                         int max_active);
+void destroy_workqueue(struct workqueue_struct *wq);
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+bool queue_work_on(int cpu,
+                   struct workqueue_struct *wq,
+                   struct work_struct *work);
+bool flush_work(struct work_struct *work);
+void drain_workqueue(struct workqueue_struct *wq);
+
+#endif  // KSHIM_LINUX_WORKQUEUE_H
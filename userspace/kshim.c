@@ -0,0 +1,361 @@
+/* Userspace implementation of the kernel services declared in
+ * userspace/include: the workqueue, the CPU count, lib/sort.c and
+ * lib/list_sort.c.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <linux/cpumask.h>
+#include <linux/list.h>
+#include <linux/list_sort.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/sort.h>
+#include <linux/workqueue.h>
+
+#include "ksort_user.h"
+
+/* Defined by sort_mod.c in the module. */
+struct workqueue_struct *workqueue;
+unsigned int sort_cpu_limit;
+unsigned int sort_slice_us = 2000;
+
+static unsigned int nr_online;
+
+/* Pool threads count as CPUs 0 .. nr_online - 1, any other thread as 0. */
+static __thread unsigned int this_cpu;
+
+unsigned int raw_smp_processor_id(void)
+{
+    return this_cpu;
+}
+
+unsigned int num_online_cpus(void)
+{
+    return nr_online;
+}
+
+struct workqueue_struct {
+    pthread_mutex_t lock;
+    pthread_cond_t more; /* work was queued, or the pool stops */
+    pthread_cond_t done; /* a work item finished */
+    struct work_struct *head, *tail;
+    struct work_struct **running; /* per thread */
+    unsigned int nr_threads, nr_running;
+    bool stop;
+    pthread_t *threads;
+};
+
+struct worker {
+    struct workqueue_struct *wq;
+    unsigned int id;
+};
+
+static void *worker_func(void *arg)
+{
+    struct worker *self = arg;
+    struct workqueue_struct *wq = self->wq;
+
+    this_cpu = self->id;
+    pthread_mutex_lock(&wq->lock);
+    for (;;) {
+        struct work_struct *work;
+
+        while (!wq->head && !wq->stop)
+            pthread_cond_wait(&wq->more, &wq->lock);
+        if (!wq->head)
+            break;
+
+        work = wq->head;
+        wq->head = work->next;
+        if (!wq->head)
+            wq->tail = NULL;
+        work->pending = false;
+        wq->running[self->id] = work;
+        wq->nr_running++;
+        pthread_mutex_unlock(&wq->lock);
+
+        /* The work may free itself; it is not touched after this. */
+        work->func(work);
+
+        pthread_mutex_lock(&wq->lock);
+        wq->running[self->id] = NULL;
+        wq->nr_running--;
+        pthread_cond_broadcast(&wq->done);
+    }
+    pthread_mutex_unlock(&wq->lock);
+
+    free(self);
+    return NULL;
+}
+
+struct workqueue_struct *alloc_workqueue(const char *fmt,
+                                         unsigned int flags,
+                                         int max_active)
+{
+    struct workqueue_struct *wq = kzalloc(sizeof(*wq), GFP_KERNEL);
+    unsigned int i;
+
+    if (!wq)
+        return NULL;
+
+    pthread_mutex_init(&wq->lock, NULL);
+    pthread_cond_init(&wq->more, NULL);
+    pthread_cond_init(&wq->done, NULL);
+    wq->threads = kcalloc(nr_online, sizeof(*wq->threads), GFP_KERNEL);
+    wq->running = kcalloc(nr_online, sizeof(*wq->running), GFP_KERNEL);
+    if (!wq->threads || !wq->running)
+        goto error;
+
+    for (i = 0; i < nr_online; i++) {
+        struct worker *w = kmalloc(sizeof(*w), GFP_KERNEL);
+
+        if (!w)
+            goto error;
+        w->wq = wq;
+        w->id = i;
+        if (pthread_create(&wq->threads[i], NULL, worker_func, w)) {
+            kfree(w);
+            goto error;
+        }
+        wq->nr_threads++;
+    }
+    return wq;
+
+error:
+    destroy_workqueue(wq);
+    return NULL;
+}
+
+void destroy_workqueue(struct workqueue_struct *wq)
+{
+    unsigned int i;
+
+    drain_workqueue(wq);
+
+    pthread_mutex_lock(&wq->lock);
+    wq->stop = true;
+    pthread_cond_broadcast(&wq->more);
+    pthread_mutex_unlock(&wq->lock);
+    for (i = 0; i < wq->nr_threads; i++)
+        pthread_join(wq->threads[i], NULL);
+
+    pthread_cond_destroy(&wq->done);
+    pthread_cond_destroy(&wq->more);
+    pthread_mutex_destroy(&wq->lock);
+    kfree(wq->running);
+    kfree(wq->threads);
+    kfree(wq);
+}
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+    bool queued = false;
+
+    pthread_mutex_lock(&wq->lock);
+    if (!work->pending) {
+        work->pending = true;
+        work->wq = wq;
+        work->next = NULL;
+        if (wq->tail)
+            wq->tail->next = work;
+        else
+            wq->head = work;
+        wq->tail = work;
+        pthread_cond_signal(&wq->more);
+        queued = true;
+    }
+    pthread_mutex_unlock(&wq->lock);
+    return queued;
+}
+
+bool queue_work_on(int cpu,
+                   struct workqueue_struct *wq,
+                   struct work_struct *work)
+{
+    return queue_work(wq, work);
+}
+
+static bool work_busy(struct workqueue_struct *wq, struct work_struct *work)
+{
+    unsigned int i;
+
+    if (work->pending)
+        return true;
+    for (i = 0; i < wq->nr_threads; i++)
+        if (wq->running[i] == work)
+            return true;
+    return false;
+}
+
+bool flush_work(struct work_struct *work)
+{
+    struct workqueue_struct *wq = work->wq;
+    bool waited = false;
+
+    if (!wq)
+        return false;
+
+    pthread_mutex_lock(&wq->lock);
+    while (work_busy(wq, work)) {
+        pthread_cond_wait(&wq->done, &wq->lock);
+        waited = true;
+    }
+    pthread_mutex_unlock(&wq->lock);
+    return waited;
+}
+
+void drain_workqueue(struct workqueue_struct *wq)
+{
+    pthread_mutex_lock(&wq->lock);
+    while (wq->head || wq->nr_running)
+        pthread_cond_wait(&wq->done, &wq->lock);
+    pthread_mutex_unlock(&wq->lock);
+}
+
+static void generic_swap(void *a, void *b, int size)
+{
+    char *p = a, *q = b;
+
+    while (size--) {
+        char t = *p;
+        *p++ = *q;
+        *q++ = t;
+    }
+}
+
+/* Bottom-up heapsort: sift down along the larger children to a leaf, then
+ * back up to where the displaced element belongs. This is the algorithm of
+ * lib/sort.c, with one comparison per level on the way down.
+ */
+void sort_r(void *base,
+            size_t num,
+            size_t size,
+            cmp_r_func_t cmp,
+            swap_func_t swap_func,
+            const void *priv)
+{
+    char *a = base;
+    size_t n = num * size, i = (num / 2) * size;
+
+    if (num < 2)
+        return;
+    if (!swap_func)
+        swap_func = generic_swap;
+
+    for (;;) {
+        size_t b, c, d;
+
+        if (i)
+            i -= size; /* heapify */
+        else if (n -= size)
+            swap_func(a, a + n, size); /* extract the root */
+        else
+            break;
+
+        for (b = i; c = 2 * b + size, (d = c + size) < n;)
+            b = cmp(a + c, a + d, priv) >= 0 ? c : d;
+        if (d == n)
+            b = c;
+
+        while (b != i && cmp(a + i, a + b, priv) >= 0)
+            b = (b - size) / 2 / size * size;
+        c = b;
+        while (b != i) {
+            b = (b - size) / 2 / size * size;
+            swap_func(a + b, a + c, size);
+        }
+    }
+}
+
+static int wrap_cmp(const void *a, const void *b, const void *priv)
+{
+    return ((cmp_func_t) priv)(a, b);
+}
+
+void sort(void *base,
+          size_t num,
+          size_t size,
+          cmp_func_t cmp,
+          swap_func_t swap_func)
+{
+    sort_r(base, num, size, wrap_cmp, swap_func, (const void *) cmp);
+}
+
+static struct list_head *list_merge(void *priv,
+                                    list_cmp_func_t cmp,
+                                    struct list_head *a,
+                                    struct list_head *b)
+{
+    struct list_head *head = NULL, **tail = &head;
+
+    while (a && b) {
+        /* if equal, take 'a' -- important for sort stability */
+        if (cmp(priv, a, b) <= 0) {
+            *tail = a;
+            tail = &a->next;
+            a = a->next;
+        } else {
+            *tail = b;
+            tail = &b->next;
+            b = b->next;
+        }
+    }
+    *tail = a ? a : b;
+    return head;
+}
+
+/* Bottom-up merge sort. pending[i] holds a sorted run of 2^i nodes, taken
+ * from earlier in the list than every lower one.
+ */
+void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+    struct list_head *pending[64] = {NULL}, *list = head->next, *prev;
+    size_t i, top = 0;
+
+    if (list == head->prev)
+        return;
+    head->prev->next = NULL;
+
+    while (list) {
+        struct list_head *run = list;
+
+        list = list->next;
+        run->next = NULL;
+        for (i = 0; pending[i]; i++) {
+            run = list_merge(priv, cmp, pending[i], run);
+            pending[i] = NULL;
+        }
+        pending[i] = run;
+        if (i >= top)
+            top = i + 1;
+    }
+
+    for (i = 0; i < top; i++) {
+        if (pending[i])
+            list = list ? list_merge(priv, cmp, pending[i], list) : pending[i];
+    }
+
+    for (prev = head; list; prev = list, list = list->next) {
+        prev->next = list;
+        list->prev = prev;
+    }
+    prev->next = head;
+    head->prev = prev;
+}
+
+int ksort_user_init(unsigned int nr_cpus)
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    nr_online = nr_cpus ? nr_cpus : online > 0 ? online : 1;
+    workqueue = alloc_workqueue("sortq", 0, WQ_MAX_ACTIVE);
+    return workqueue ? 0 : -ENOMEM;
+}
+
+void ksort_user_exit(void)
+{
+    destroy_workqueue(workqueue);
+    workqueue = NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef KSORT_USER_H
+#define KSORT_USER_H
+
+/* libksort.a is the userspace build of the sort engines. The kernel APIs
+ * they call come from the headers under userspace/include, and the
+ * module's workqueue is replaced by a pthread pool.
+ */
+
+/* Start the pool with nr_cpus threads, or one per online CPU if 0; the
+ * engines then see nr_cpus online CPUs. Returns 0 or a negative errno.
+ */
+int ksort_user_init(unsigned int nr_cpus);
+
+void ksort_user_exit(void);
+
+#endif  // KSORT_USER_H
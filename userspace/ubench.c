@@ -0,0 +1,224 @@
+/* Compares the sort engines built into libksort.a with glibc qsort() and,
+ * when the module is loaded, with the same engines behind /dev/sort. The
+ * gap between a wall time and its sort time is the cost outside the
+ * algorithm: list conversion and output passes in the library, plus the
+ * system call and user copies through the device.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ksort_user.h"
+#include "sort.h"
+
+#define KSORT_DEV "/dev/sort"
+
+static const struct {
+    const char *name;
+    sort_method_t method;
+} engines[] = {
+    {"qsort", QSORT},
+    {"timsort", TIMSORT},
+    {"linuxsort", LINUX_SORT},
+    {"inplace", INPLACE_SORT},
+    {"count", COUNT_SORT},
+};
+
+/* Median of the sort and wall times of one engine, in ns. */
+struct result {
+    unsigned long long sort_ns, wall_ns;
+};
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    int x = *(const int *) a, y = *(const int *) b;
+
+    return (x > y) - (x < y);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *) a;
+    unsigned long long y = *(const unsigned long long *) b;
+
+    return (x > y) - (x < y);
+}
+
+static unsigned long long median(unsigned long long *v, unsigned reps)
+{
+    qsort(v, reps, sizeof(*v), cmp_ull);
+    return v[reps / 2];
+}
+
+static bool is_sorted(const int *a, size_t n)
+{
+    for (size_t i = 1; i < n; i++) {
+        if (a[i] < a[i - 1])
+            return false;
+    }
+    return true;
+}
+
+/* Sort through the library, or through fd when it is not negative. */
+static bool run_engine(int fd,
+                       sort_method_t method,
+                       const int *input,
+                       int *work,
+                       size_t n,
+                       unsigned reps,
+                       struct result *res)
+{
+    unsigned long long sort_ns[reps], wall_ns[reps];
+    size_t size = n * sizeof(int);
+
+    if (fd >= 0 && write(fd, &method, sizeof(method)) != sizeof(method))
+        return false;
+
+    for (unsigned r = 0; r < reps; r++) {
+        unsigned long long start;
+        ssize_t bytes;
+
+        memcpy(work, input, size);
+        start = now_ns();
+        if (fd >= 0) {
+            bytes = read(fd, work, size);
+            wall_ns[r] = now_ns() - start;
+            sort_ns[r] = ioctl(fd, SORT_IOC_TIME, 0);
+        } else {
+            sort_ns[r] = sort_main(work, n, sizeof(int), method, NULL,
+                                   SORT_OUTPUT_ALL, &bytes);
+            wall_ns[r] = now_ns() - start;
+        }
+        if (bytes != (ssize_t) size || !is_sorted(work, n))
+            return false;
+    }
+
+    res->sort_ns = median(sort_ns, reps);
+    res->wall_ns = median(wall_ns, reps);
+    return true;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-n N] [-r REPS] [-j CPUS] [-s SEED]\n"
+            "  -n N     number of random ints (default: 1000000)\n"
+            "  -r REPS  repetitions, the median is reported (default: 5)\n"
+            "  -j CPUS  threads of the pool (default: online CPUs)\n"
+            "  -s SEED  input seed (default: 1)\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = 1000000;
+    unsigned reps = 5, cpus = 0;
+    uint64_t seed = 1;
+    int c, fd, ret = 1;
+
+    while ((c = getopt(argc, argv, "n:r:j:s:h")) != -1) {
+        switch (c) {
+        case 'n':
+            n = strtoull(optarg, NULL, 0);
+            break;
+        case 'r':
+            reps = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            cpus = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!n || !reps) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int *input = malloc(n * sizeof(int));
+    int *work = malloc(n * sizeof(int));
+    if (!input || !work || ksort_user_init(cpus)) {
+        perror("Failed to set up benchmark");
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++)
+        input[i] = (int) (splitmix64(&seed) % n);
+
+    fd = open(KSORT_DEV, O_RDWR);
+
+    printf("%-10s %14s %14s %14s %14s\n", "engine", "lib_sort_ns",
+           "lib_wall_ns", "dev_sort_ns", "dev_wall_ns");
+
+    unsigned long long wall_ns[reps];
+    for (unsigned r = 0; r < reps; r++) {
+        unsigned long long start;
+
+        memcpy(work, input, n * sizeof(int));
+        start = now_ns();
+        qsort(work, n, sizeof(int), cmp_int);
+        wall_ns[r] = now_ns() - start;
+    }
+    unsigned long long glibc_ns = median(wall_ns, reps);
+    printf("%-10s %14llu %14llu %14s %14s\n", "glibc", glibc_ns, glibc_ns,
+           "-", "-");
+
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        struct result lib, dev;
+
+        if (!run_engine(-1, engines[e].method, input, work, n, reps, &lib)) {
+            fprintf(stderr, "%s failed in the library\n", engines[e].name);
+            goto out;
+        }
+        printf("%-10s %14llu %14llu", engines[e].name, lib.sort_ns,
+               lib.wall_ns);
+
+        if (fd < 0) {
+            printf(" %14s %14s\n", "-", "-");
+        } else if (run_engine(fd, engines[e].method, input, work, n, reps,
+                              &dev)) {
+            printf(" %14llu %14llu\n", dev.sort_ns, dev.wall_ns);
+        } else {
+            printf("\n");
+            fprintf(stderr, "%s failed through %s\n", engines[e].name,
+                    KSORT_DEV);
+            goto out;
+        }
+    }
+    ret = 0;
+
+out:
+    if (fd >= 0)
+        close(fd);
+    ksort_user_exit();
+    free(work);
+    free(input);
+    return ret;
+}
@@ -4,17 +4,23 @@
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
 
+#include "xoro_types.h"
+
 #define DEVICE_NAME "xoro"
 #define CLASS_NAME "xoro"
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("National Cheng Kung University, Taiwan");
-MODULE_DESCRIPTION("Xoroshiro128p PRNG");
+MODULE_DESCRIPTION("Xoroshiro128+/++ and xoshiro256** PRNG");
 MODULE_VERSION("0.1");
 
 static int major_number;
@@ -23,9 +29,12 @@ static struct device *dev_device = NULL;
 
 static int n_opens = 0; /* Count the number of times device is opened. */
 
-/* Mutex to allow only one userspace program to read at once. */
+/* Mutex to serialize the jumps of the master generator in dev_open(). */
 static DEFINE_MUTEX(xoro_mutex);
 
+/* Bytes generated per copy_to_user() in dev_read(). */
+#define XORO_CHUNK PAGE_SIZE
+
 /* This is xoroshiro128+ 1.0, written by David Blackman and Sebastiano Vigna
  * (vigna@acm.org). It passes all tests we are aware of except for the four
  * lower bits, which might fail linearity tests (and just those), so if
@@ -52,16 +61,17 @@ static inline uint64_t rotl(const uint64_t x, int k)
     return (x << k) | (x >> (64 - k));
 }
 
-static uint64_t s[2];
+/* Master state; every open takes its own copy after a long_jump(). */
+static uint64_t master[2];
 
-static void seed(uint64_t s0, uint64_t s1)
+static void seed(uint64_t s[2], uint64_t s0, uint64_t s1)
 {
     s[0] = s0;
     s[1] = s1;
     return;
 }
 
-static uint64_t next(void)
+static inline uint64_t next(uint64_t *s)
 {
     const uint64_t s0 = s[0];
     uint64_t s1 = s[1];
@@ -74,36 +84,407 @@ static uint64_t next(void)
     return result;
 }
 
-/* This is the jump function for the generator. It is equivalent to 2^64 calls
- * to next(); it can be used to generate 2^64 non-overlapping subsequences for
- * parallel computations.
+/* xoroshiro128++ 1.0: the same 128-bit state, with a scrambler that has no
+ * linearity issue in the low bits.
  */
-static void jump(void)
+static inline uint64_t next_pp(uint64_t *s)
 {
-    static const uint64_t JUMP[] = {0xdf900294d8f554a5, 0x170865df4b3201fc};
+    const uint64_t s0 = s[0];
+    uint64_t s1 = s[1];
+    const uint64_t result = rotl(s0 + s1, 17) + s0;
 
-    uint64_t s0 = 0;
-    uint64_t s1 = 0;
-    int i, b;
-    for (i = 0; i < sizeof JUMP / sizeof *JUMP; i++)
+    s1 ^= s0;
+    s[0] = rotl(s0, 49) ^ s1 ^ (s1 << 21); /* a, b */
+    s[1] = rotl(s1, 28);                   /* c */
+
+    return result;
+}
+
+/* xoshiro256** 1.0: 256 bits of state for when 2^128 - 1 is too short a
+ * period, e.g. many lanes of many readers.
+ */
+static inline uint64_t next_ss(uint64_t *s)
+{
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+
+    s[2] ^= t;
+
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+static uint64_t next_fn(uint64_t *s)
+{
+    return next(s);
+}
+
+static uint64_t next_pp_fn(uint64_t *s)
+{
+    return next_pp(s);
+}
+
+static uint64_t next_ss_fn(uint64_t *s)
+{
+    return next_ss(s);
+}
+
+/* Number of state words of the largest generator. */
+#define XORO_WORDS 4
+
+struct xoro_gen {
+    int words;
+    uint64_t (*next)(uint64_t *s);
+    const uint64_t *jump; /* words entries */
+};
+
+static const uint64_t JUMP_128P[] = {0xdf900294d8f554a5, 0x170865df4b3201fc};
+static const uint64_t LONG_JUMP_128P[] = {0xd2a98b26625eee7b,
+                                          0xdddf9b1090aa7ac1};
+static const uint64_t JUMP_128PP[] = {0x2bd7a6a6e99c2ddc, 0x0992ccaf6a6fca05};
+static const uint64_t JUMP_256SS[] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+                                      0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+
+static const struct xoro_gen gens[] = {
+    [XORO_128_PLUS] = {2, next_fn, JUMP_128P},
+    [XORO_128_PLUSPLUS] = {2, next_pp_fn, JUMP_128PP},
+    [XOSHIRO_256_STARSTAR] = {4, next_ss_fn, JUMP_256SS},
+};
+
+/* This is the jump function for the generators. With the JUMP polynomial of
+ * a generator it is equivalent to 2^64 calls to next() (2^128 for xoshiro256);
+ * it can be used to generate non-overlapping subsequences for parallel
+ * computations.
+ */
+static void jump(uint64_t *s,
+                 int words,
+                 const uint64_t *poly,
+                 uint64_t (*step)(uint64_t *))
+{
+    uint64_t t[XORO_WORDS] = {0};
+    int i, b, w;
+
+    for (i = 0; i < words; i++)
         for (b = 0; b < 64; b++) {
-            if (JUMP[i] & (uint64_t) (1) << b) {
-                s0 ^= s[0];
-                s1 ^= s[1];
+            if (poly[i] & (uint64_t) (1) << b)
+                for (w = 0; w < words; w++)
+                    t[w] ^= s[w];
+            step(s);
+        }
+
+    memcpy(s, t, words * sizeof(*s));
+}
+
+/* Equivalent to 2^96 calls to next(); spaces the readers far enough apart
+ * that each of them can split its stream into lanes with jump().
+ */
+static void long_jump(uint64_t s[2])
+{
+    jump(s, 2, LONG_JUMP_128P, next_fn);
+}
+
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/* Interleaved streams of one reader. Output word i comes from lane
+ * i % XORO_LANES, so the lanes' dependency chains overlap in the pipeline.
+ * The lanes are unrolled by hand in DEFINE_XORO_FILL.
+ */
+#define XORO_LANES 4
+
+struct xoro_state {
+    struct mutex lock;
+    xoro_gen_t gen;
+    uint64_t s[XORO_LANES][XORO_WORDS];
+};
+
+/* Derive lanes 1.. from lane 0, one jump() apart. */
+static void xoro_spread(struct xoro_state *st)
+{
+    const struct xoro_gen *g = &gens[st->gen];
+    int l;
+
+    for (l = 1; l < XORO_LANES; l++) {
+        memcpy(st->s[l], st->s[l - 1], sizeof(st->s[l]));
+        jump(st->s[l], g->words, g->jump, g->next);
+    }
+}
+
+static void xoro_seed(struct xoro_state *st, xoro_gen_t gen, uint64_t x)
+{
+    int w;
+
+    st->gen = gen;
+    memset(st->s, 0, sizeof(st->s));
+    for (w = 0; w < gens[gen].words; w++)
+        st->s[0][w] = splitmix64(&x);
+    xoro_spread(st);
+}
+
+/* Fill n words of out, n being a multiple of XORO_LANES. The lanes are
+ * worked on in a local copy so the stores to out cannot alias them.
+ */
+#define DEFINE_XORO_FILL(name, step)                                 \
+    static void name(uint64_t (*s)[XORO_WORDS], uint64_t *out,       \
+                     size_t n)                                       \
+    {                                                                \
+        uint64_t l[XORO_LANES][XORO_WORDS];                          \
+        size_t i;                                                    \
+                                                                     \
+        memcpy(l, s, sizeof(l));                                     \
+        for (i = 0; i < n; i += XORO_LANES) {                        \
+            out[i] = step(l[0]);                                     \
+            out[i + 1] = step(l[1]);                                 \
+            out[i + 2] = step(l[2]);                                 \
+            out[i + 3] = step(l[3]);                                 \
+        }                                                            \
+        memcpy(s, l, sizeof(l));                                     \
+    }
+
+DEFINE_XORO_FILL(fill_128p, next)
+DEFINE_XORO_FILL(fill_128pp, next_pp)
+DEFINE_XORO_FILL(fill_256ss, next_ss)
+
+static void xoro_fill(struct xoro_state *st, uint64_t *out, size_t n)
+{
+    switch (st->gen) {
+    case XORO_128_PLUS:
+        fill_128p(st->s, out, n);
+        break;
+    case XORO_128_PLUSPLUS:
+        fill_128pp(st->s, out, n);
+        break;
+    case XOSHIRO_256_STARSTAR:
+        fill_256ss(st->s, out, n);
+        break;
+    }
+}
+
+/* Distribution-shaped keys for XORO_IOC_FILL. Keys are built as offsets
+ * from lo in [0, hi - lo], so the full s64 range needs no special case.
+ */
+struct dist_gen {
+    const struct xoro_fill *req;
+    uint64_t span;   /* hi - lo */
+    uint64_t run;    /* SORTED, REVERSE, NEARLY_SORTED: run length */
+    uint64_t step;   /* FEW_UNIQUE: distance between the keys */
+    uint64_t log2_n; /* ZIPF: log2(span + 2) in 32.32 fixed point */
+    uint64_t sd;     /* GAUSSIAN: standard deviation */
+    uint64_t pos;    /* position within the current run */
+    uint64_t val;    /* offset of the next key of the run */
+};
+
+/* Random words consumed per key. */
+static int dist_words(xoro_dist_t dist)
+{
+    switch (dist) {
+    case XORO_DIST_UNIFORM:
+    case XORO_DIST_FEW_UNIQUE:
+    case XORO_DIST_ZIPF:
+        return 1;
+    case XORO_DIST_GAUSSIAN:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+/* log2(x) for x >= 2 in 32.32 fixed point, one fraction bit per squaring. */
+static uint64_t log2_fixed(uint64_t x)
+{
+    unsigned int k = ilog2(x);
+    uint64_t y = k >= 31 ? x >> (k - 31) : x << (31 - k); /* 1.31 */
+    uint64_t r = (uint64_t) k << 32;
+    int i;
+
+    for (i = 31; i >= 0; i--) {
+        y = (y * y) >> 31;
+        if (y >= 1ULL << 32) {
+            y >>= 1;
+            r |= 1ULL << i;
+        }
+    }
+    return r;
+}
+
+/* 2^f for f in [0, 1) given as 0.32 fixed point, returned as 32.32. The
+ * quadratic 1 + 0.6602 f + 0.3398 f^2 is within 0.27% of it.
+ */
+static uint64_t exp2_frac(uint32_t f)
+{
+    uint64_t f2 = ((uint64_t) f * f) >> 32;
+
+    return (1ULL << 32) + ((2835537409ULL * f) >> 32) +
+           ((1459429887ULL * f2) >> 32);
+}
+
+/* Log-uniform offset: v = (span + 2)^u for uniform u, so v has a density
+ * proportional to 1/v over [1, span + 2), the continuous Zipf with s = 1.
+ */
+static uint64_t zipf_offset(const struct dist_gen *g, uint64_t r)
+{
+    uint64_t t = mul_u64_u64_shr(r, g->log2_n, 64);
+    unsigned int k = t >> 32;
+    uint64_t e = exp2_frac((uint32_t) t);
+    uint64_t v = k >= 32 ? e << (k - 32) : e >> (32 - k);
+
+    return min(v - 1, g->span);
+}
+
+/* Irwin-Hall: the sum of twelve 16-bit uniforms, less their mean, is close
+ * to a standard normal deviate scaled by 2^16.
+ */
+static uint64_t gaussian_offset(const struct dist_gen *g, const uint64_t *r)
+{
+    uint64_t mean = g->span / 2, mag;
+    int64_t z = -6 * 65536;
+    int i, b;
+
+    for (i = 0; i < 3; i++)
+        for (b = 0; b < 64; b += 16)
+            z += (r[i] >> b) & 0xffff;
+
+    mag = mul_u64_u64_shr(z < 0 ? -z : z, g->sd, 16);
+    if (z < 0)
+        return mag > mean ? 0 : mean - mag;
+    return mag > g->span - mean ? g->span : mean + mag;
+}
+
+static int dist_init(struct dist_gen *g, const struct xoro_fill *req)
+{
+    if (!is_valid_xoro_dist(req->dist) || req->lo > req->hi)
+        return -EINVAL;
+    if (req->width != 1 && req->width != 2 && req->width != 4 &&
+        req->width != 8)
+        return -EINVAL;
+    if (req->dist == XORO_DIST_FEW_UNIQUE && !req->param)
+        return -EINVAL;
+
+    memset(g, 0, sizeof(*g));
+    g->req = req;
+    g->span = (uint64_t) req->hi - (uint64_t) req->lo;
+
+    switch (req->dist) {
+    case XORO_DIST_SORTED:
+    case XORO_DIST_REVERSE:
+        g->run = req->param ? req->param : req->count;
+        break;
+    case XORO_DIST_NEARLY_SORTED:
+        g->run = req->count;
+        break;
+    case XORO_DIST_FEW_UNIQUE:
+        g->step = req->param > 1 ? g->span / (req->param - 1) : 0;
+        break;
+    case XORO_DIST_ZIPF:
+        g->log2_n =
+            g->span >= U64_MAX - 1 ? 64ULL << 32 : log2_fixed(g->span + 2);
+        break;
+    case XORO_DIST_GAUSSIAN:
+        g->sd = req->param ? req->param : g->span / 6;
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+/* Produce the next n keys into out, using rnd for the random words. */
+static void dist_batch(struct dist_gen *g,
+                       struct xoro_state *st,
+                       uint64_t *out,
+                       uint64_t *rnd,
+                       size_t n)
+{
+    const struct xoro_fill *req = g->req;
+    int words = dist_words(req->dist);
+    size_t i;
+
+    if (words)
+        xoro_fill(st, rnd, round_up(n * words, XORO_LANES));
+
+    switch (req->dist) {
+    case XORO_DIST_UNIFORM:
+        for (i = 0; i < n; i++)
+            out[i] = g->span == U64_MAX
+                         ? rnd[i]
+                         : mul_u64_u64_shr(rnd[i], g->span + 1, 64);
+        break;
+    case XORO_DIST_SORTED:
+    case XORO_DIST_REVERSE:
+    case XORO_DIST_NEARLY_SORTED:
+        for (i = 0; i < n; i++) {
+            if (g->pos == g->run) {
+                g->pos = 0;
+                g->val = 0;
             }
-            next();
+            out[i] = req->dist == XORO_DIST_REVERSE ? g->span - g->val
+                                                    : g->val;
+            g->val = g->val == g->span ? 0 : g->val + 1;
+            g->pos++;
         }
+        break;
+    case XORO_DIST_FEW_UNIQUE:
+        for (i = 0; i < n; i++)
+            out[i] = mul_u64_u64_shr(rnd[i], req->param, 64) * g->step;
+        break;
+    case XORO_DIST_ZIPF:
+        for (i = 0; i < n; i++)
+            out[i] = zipf_offset(g, rnd[i]);
+        break;
+    case XORO_DIST_GAUSSIAN:
+        for (i = 0; i < n; i++)
+            out[i] = gaussian_offset(g, rnd + 3 * i);
+        break;
+    }
 
-    s[0] = s0;
-    s[1] = s1;
+    for (i = 0; i < n; i++)
+        out[i] += (uint64_t) req->lo;
+}
+
+/* Narrow the n keys in place to width bytes each. Key i lands at or before
+ * where key i + 1 is read from, so the forward pass never overwrites a key
+ * it still needs.
+ */
+static void pack_keys(uint64_t *keys, size_t n, unsigned int width)
+{
+    size_t i;
+
+    switch (width) {
+    case 1:
+        for (i = 0; i < n; i++)
+            ((uint8_t *) keys)[i] = keys[i];
+        break;
+    case 2:
+        for (i = 0; i < n; i++)
+            ((uint16_t *) keys)[i] = keys[i];
+        break;
+    case 4:
+        for (i = 0; i < n; i++)
+            ((uint32_t *) keys)[i] = keys[i];
+        break;
+    }
 }
 
 static int dev_open(struct inode *, struct file *);
 static int dev_release(struct inode *, struct file *);
 static ssize_t dev_read(struct file *, char *, size_t, loff_t *);
+static long dev_ioctl(struct file *, unsigned int, unsigned long);
 static struct file_operations fops = {
     .open = dev_open,
     .read = dev_read,
+    .unlocked_ioctl = dev_ioctl,
     .release = dev_release,
 };
 
@@ -147,7 +528,7 @@ static int __init xoro_init(void)
 
     mutex_init(&xoro_mutex);
 
-    seed(314159265, 1618033989);  // Initialize PRNG with pi and phi.
+    seed(master, 314159265, 1618033989);  // Initialize PRNG with pi and phi.
 
     printk(KERN_INFO "XORO:   Initialized\n");
     return 0;
@@ -173,28 +554,40 @@ static void __exit xoro_exit(void)
 
 /**
  * open() syscall.
- * Increment counter, perform another jump to effectively give each
- * reader a separate PRNG.
+ * Increment counter, perform another long jump to effectively give each
+ * reader a separate xoroshiro128+, kept in filep->private_data.
  * @inodep Pointer to an inode object (defined in linux/fs.h)
  * @filep Pointer to a file object (defined in linux/fs.h)
  */
 static int dev_open(struct inode *inodep, struct file *filep)
 {
-    /* Try to acquire the mutex (returns 0 on fail) */
-    if (!mutex_trylock(&xoro_mutex)) {
-        printk(KERN_INFO "XORO: %s busy\n", DEVICE_NAME);
-        return -EBUSY;
-    }
+    struct xoro_state *st = kzalloc(sizeof(*st), GFP_KERNEL);
+    if (!st)
+        return -ENOMEM;
+
+    mutex_init(&st->lock);
+    st->gen = XORO_128_PLUS;
 
-    jump();  // xorolus.c
+    mutex_lock(&xoro_mutex);
+    long_jump(master);
+    memcpy(st->s[0], master, sizeof(master));
+    n_opens++;
+    mutex_unlock(&xoro_mutex);
+
+    xoro_spread(st);
+
+    pr_debug("XORO: %s opened. n_opens=%d\n", DEVICE_NAME, n_opens);
 
-    printk(KERN_INFO "XORO: %s opened. n_opens=%d\n", DEVICE_NAME, n_opens++);
+    filep->private_data = st;
 
     return 0;
 }
 
 /**
  * Called whenever device is read from user space.
+ * Fills the whole buffer from this reader's own generator, a page at a time.
+ * Words are generated in groups of XORO_LANES; the bytes of a group that do
+ * not fit in the buffer are dropped.
  * @filep Pointer to a file object (defined in linux/fs.h).
  * @buffer Pointer to the buffer to which this function may write data.
  * @len Number of bytes requested.
@@ -206,21 +599,179 @@ static ssize_t dev_read(struct file *filep,
                         size_t len,
                         loff_t *offset)
 {
-    // Give at most 8 bytes per read.
-    size_t len_ = (len > 8) ? 8 : len;
+    struct xoro_state *st = filep->private_data;
+    uint64_t *chunk;
+    size_t done = 0;
+    bool fault = false;
+
+    BUILD_BUG_ON(XORO_CHUNK % (XORO_LANES * sizeof(*chunk)));
+
+    chunk = kmalloc(XORO_CHUNK, GFP_KERNEL);
+    if (!chunk)
+        return -ENOMEM;
+
+    mutex_lock(&st->lock);
+    while (done < len) {
+        size_t len_ = min_t(size_t, len - done, XORO_CHUNK);
+
+        xoro_fill(st, chunk,
+                  round_up(DIV_ROUND_UP(len_, sizeof(*chunk)), XORO_LANES));
+
+        // copy_to_user has the format ( * to, *from, size) and returns 0 on
+        // success
+        if (copy_to_user(buffer + done, chunk, len_)) {
+            printk(KERN_ALERT "XORO: Failed to read %zu/%zu bytes\n",
+                   len - done, len);
+            fault = true;
+            break;
+        }
+        done += len_;
+
+        if (fatal_signal_pending(current))
+            break;
+        cond_resched();
+    }
+    mutex_unlock(&st->lock);
+
+    kfree(chunk);
+    /* A fault past the first chunk still reports what was copied. */
+    return fault && !done ? -EFAULT : done;
+}
+
+/* Swap nr pairs of random keys of the user buffer. */
+static int swap_keys(struct xoro_state *st,
+                     char __user *buf,
+                     uint64_t count,
+                     unsigned int width,
+                     uint64_t nr)
+{
+    uint64_t r[XORO_LANES];
+    uint64_t i;
+
+    for (i = 0; i < nr; i++) {
+        uint64_t x = 0, y = 0;
+        char __user *a, *b;
+
+        if (!(i % (XORO_LANES / 2)))
+            xoro_fill(st, r, XORO_LANES);
+        a = buf + mul_u64_u64_shr(r[2 * (i % 2)], count, 64) * width;
+        b = buf + mul_u64_u64_shr(r[2 * (i % 2) + 1], count, 64) * width;
+
+        if (copy_from_user(&x, a, width) || copy_from_user(&y, b, width) ||
+            copy_to_user(a, &y, width) || copy_to_user(b, &x, width))
+            return -EFAULT;
+
+        if (!(i % 4096)) {
+            if (fatal_signal_pending(current))
+                return -EINTR;
+            cond_resched();
+        }
+    }
+    return 0;
+}
+
+/* XORO_IOC_FILL: generate the keys a page at a time, as dev_read() does. */
+static long fill_keys(struct xoro_state *st, const struct xoro_fill *req)
+{
+    char __user *buf = u64_to_user_ptr(req->buf);
+    struct dist_gen g;
+    uint64_t *keys, *rnd;
+    uint64_t done = 0;
+    size_t batch;
+    long ret;
+
+    ret = dist_init(&g, req);
+    if (ret)
+        return ret;
+    if (req->count > SIZE_MAX / req->width)
+        return -EINVAL;
+
+    batch = XORO_CHUNK / sizeof(*keys) / max(dist_words(req->dist), 1);
+
+    keys = kmalloc(XORO_CHUNK, GFP_KERNEL);
+    rnd = kmalloc(XORO_CHUNK, GFP_KERNEL);
+    if (!keys || !rnd) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    while (done < req->count) {
+        size_t n = min_t(uint64_t, req->count - done, batch);
+
+        dist_batch(&g, st, keys, rnd, n);
+        pack_keys(keys, n, req->width);
+        if (copy_to_user(buf + done * req->width, keys, n * req->width)) {
+            ret = -EFAULT;
+            goto out;
+        }
+        done += n;
+
+        if (fatal_signal_pending(current)) {
+            ret = -EINTR;
+            goto out;
+        }
+        cond_resched();
+    }
+
+    if (req->dist == XORO_DIST_NEARLY_SORTED && req->count)
+        ret = swap_keys(st, buf, req->count, req->width, req->param);
+
+out:
+    kfree(rnd);
+    kfree(keys);
+    return ret;
+}
+
+static long set_config(struct xoro_state *st, const struct xoro_config *cfg)
+{
+    uint64_t x;
 
-    uint64_t value = next();  // xorolus.c
+    if (!is_valid_xoro_gen(cfg->gen) || (cfg->flags & ~XORO_SEED))
+        return -EINVAL;
 
-    // copy_to_user has the format ( * to, *from, size) and returns 0 on success
-    int n_notcopied = copy_to_user(buffer, (char *) (&value), len_);
+    x = (cfg->flags & XORO_SEED) ? cfg->seed : gens[st->gen].next(st->s[0]);
+    xoro_seed(st, cfg->gen, x);
+    return 0;
+}
 
-    if (0 != n_notcopied) {
-        printk(KERN_ALERT "XORO: Failed to read %d/%ld bytes\n", n_notcopied,
-               len_);
-        return -EFAULT;
-    } else {
-        printk(KERN_INFO "XORO: read %ld bytes\n", len_);
-        return len_;
+/**
+ * ioctl() syscall.
+ * XORO_IOC_CONFIG selects the generator of this reader and reseeds it;
+ * XORO_IOC_FILL writes keys of a given distribution to a user buffer.
+ * @filep Pointer to a file object (defined in linux/fs.h).
+ * @cmd The request code.
+ * @arg Pointer to the request's argument struct in user space.
+ * Returns 0 on success, negative on error.
+ */
+static long dev_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+{
+    struct xoro_state *st = filep->private_data;
+    void __user *uarg = (void __user *) arg;
+    long ret;
+
+    switch (cmd) {
+    case XORO_IOC_CONFIG: {
+        struct xoro_config cfg;
+
+        if (copy_from_user(&cfg, uarg, sizeof(cfg)))
+            return -EFAULT;
+        mutex_lock(&st->lock);
+        ret = set_config(st, &cfg);
+        mutex_unlock(&st->lock);
+        return ret;
+    }
+    case XORO_IOC_FILL: {
+        struct xoro_fill req;
+
+        if (copy_from_user(&req, uarg, sizeof(req)))
+            return -EFAULT;
+        mutex_lock(&st->lock);
+        ret = fill_keys(st, &req);
+        mutex_unlock(&st->lock);
+        return ret;
+    }
+    default:
+        return -ENOTTY;
     }
 }
 
@@ -231,8 +782,10 @@ static ssize_t dev_read(struct file *filep,
  */
 static int dev_release(struct inode *inodep, struct file *filep)
 {
-    mutex_unlock(&xoro_mutex);
-    printk(KERN_INFO "XORO: %s closed\n", DEVICE_NAME);
+    struct xoro_state *st = filep->private_data;
+
+    mutex_destroy(&st->lock);
+    kfree(st);
     return 0;
 }
 
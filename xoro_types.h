@@ -0,0 +1,75 @@
+#ifndef XORO_TYPES_H
+#define XORO_TYPES_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+typedef enum {
+    XORO_128_PLUS,
+    XORO_128_PLUSPLUS,
+    XOSHIRO_256_STARSTAR
+} xoro_gen_t;
+
+static inline int is_valid_xoro_gen(unsigned long gen)
+{
+    return gen <= XOSHIRO_256_STARSTAR;
+}
+
+/* Seed the generator from seed. Without it, the new generator is seeded
+ * from the output of the current one, so readers stay independent.
+ */
+#define XORO_SEED 0x1
+
+struct xoro_config {
+    __u32 gen; /* xoro_gen_t */
+    __u32 flags;
+    __u64 seed;
+};
+
+#define XORO_IOC_MAGIC 'x'
+
+/* Select the generator of this open file, and optionally its seed. */
+#define XORO_IOC_CONFIG _IOW(XORO_IOC_MAGIC, 1, struct xoro_config)
+
+/* Shapes of the keys written by XORO_IOC_FILL. Every key lies in [lo, hi];
+ * param means:
+ *   UNIFORM        unused
+ *   SORTED         length of each ascending run, 0 for a single run. A run
+ *                  counts up from lo and wraps around after hi.
+ *   REVERSE        as SORTED, counting down from hi
+ *   NEARLY_SORTED  number of random swaps applied to a single sorted run
+ *   FEW_UNIQUE     number of distinct keys, spread evenly over [lo, hi]
+ *   ZIPF           unused; key lo + k - 1 has probability about 1/k
+ *   GAUSSIAN       standard deviation around (lo + hi) / 2, 0 for
+ *                  (hi - lo) / 6. Keys outside [lo, hi] are clamped.
+ */
+typedef enum {
+    XORO_DIST_UNIFORM,
+    XORO_DIST_SORTED,
+    XORO_DIST_REVERSE,
+    XORO_DIST_NEARLY_SORTED,
+    XORO_DIST_FEW_UNIQUE,
+    XORO_DIST_ZIPF,
+    XORO_DIST_GAUSSIAN
+} xoro_dist_t;
+
+static inline int is_valid_xoro_dist(unsigned long dist)
+{
+    return dist <= XORO_DIST_GAUSSIAN;
+}
+
+/* Fill buf with count keys of width bytes each (1, 2, 4 or 8), stored in
+ * native byte order and truncated to width.
+ */
+struct xoro_fill {
+    __u64 buf;
+    __u64 count;
+    __s64 lo, hi;
+    __u64 param;
+    __u32 dist; /* xoro_dist_t */
+    __u32 width;
+};
+
+#define XORO_IOC_FILL _IOW(XORO_IOC_MAGIC, 2, struct xoro_fill)
+
+#endif  // XORO_TYPES_H